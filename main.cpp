@@ -6,6 +6,9 @@
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 #include <map>
+#include <cstring>
+#include <cstdlib>
+#include <fstream>
 
 #include "src/window/window.h"
 #include "src/shaders/shader.h"
@@ -15,11 +18,17 @@
 #include "src/lights/directionallight.h"
 #include "src/lights/spotlight.h"
 #include "src/model/model.h"
+#include "src/model/modelregistry.h"
+#include "src/model/assetloader.h"
+#include "src/textures/texturecache.h"
 #include "src/utils/stb_image.h"
 #include "src/utils/fileutils.h"
+#include "src/utils/glstate.h"
 #include "src/buffers/framebuffer.h"
 #include "src/pipeline/pipeline.h"
 #include "src/renderables/Emissive.h"
+#include "src/benchmark/profiler.h"
+#include "src/benchmark/camerapath.h"
 
 static const GLuint POINT_LIGHTS = 16;
 
@@ -29,6 +38,9 @@ static const GLuint SCR_HEIGHT = 1024;
 static const GLuint SHADOW_WIDTH = 1024;
 static const GLuint SHADOW_HEIGHT = 1024;
 
+// Time each frame may spend on GL uploads of streamed assets
+static const double UPLOAD_BUDGET_MS = 2.0;
+
 float deltaTime = 0.0f;
 float lastFrame = 0.0f;
 
@@ -37,7 +49,7 @@ GLuint loadTexture(char const* path);
 void initCubeVAO(VertexArray& cubeVAO);
 void initPlaneVAO(VertexArray& planeVAO);
 void initQuadVAO(VertexArray& quadVAO);
-std::vector<PointLight> initLights();
+std::vector<PointLight> initLights(GLsizei count);
 void drawPlane(const Shader& shader, const VertexArray& VAO, GLuint texture = 0);
 void drawSkybox(const Shader& shader, const VertexArray& VAO, GLuint texture = 0);
 void drawCubes(const Shader& shader, std::vector<glm::vec3> objectPositions, const VertexArray& VAO, GLuint diffuse, GLuint normal, GLuint specular, GLuint height);
@@ -46,11 +58,92 @@ void drawWindows(const Shader& shader, const VertexArray& VAO, GLuint texture, s
 
 GLuint loadSkybox(std::vector<std::string> faces);
 
-int main()
+int main(int argc, char** argv)
 {
+    // Parse Arguments
+    // ---------------
+    bool headless = false;
+    bool benchmark = false;
+    int frameLimit = 0;
+    int warmupFrames = 0;
+    float timestep = 1.0f / 60.0f;
+    const char* cameraPathFile = NULL;
+    const char* recordFile = NULL;
+    const char* outputFile = NULL;
+    int lightCount = POINT_LIGHTS;
+    LightingMode lightingMode = LightingMode::Clustered;
+    bool frustumCulling = true;
+    bool occlusionCulling = false;
+    bool depthPrepass = false;
+    GBufferLayout gBufferLayout = GBufferLayout::Compact;
+    BloomMode bloomMode = BloomMode::MipChain;
+    int bloomLevels = 6;
+    float bloomRadius = 1.0f;
+    // Filter fused into the final pass, see PostProcessing.frag
+    const char* postFilter = "none";
+    float sharpness = 0.5f;
+    for (int i = 1; i < argc; i++)
+    {
+        if (std::strcmp(argv[i], "--headless") == 0)
+            headless = true;
+        else if (std::strcmp(argv[i], "--benchmark") == 0)
+            benchmark = true;
+        else if (std::strcmp(argv[i], "--frames") == 0 && i + 1 < argc)
+            frameLimit = std::atoi(argv[++i]);
+        else if (std::strcmp(argv[i], "--warmup") == 0 && i + 1 < argc)
+            warmupFrames = std::atoi(argv[++i]);
+        else if (std::strcmp(argv[i], "--timestep") == 0 && i + 1 < argc)
+            timestep = (float)std::atof(argv[++i]);
+        else if (std::strcmp(argv[i], "--camera-path") == 0 && i + 1 < argc)
+            cameraPathFile = argv[++i];
+        else if (std::strcmp(argv[i], "--record") == 0 && i + 1 < argc)
+            recordFile = argv[++i];
+        else if (std::strcmp(argv[i], "--output") == 0 && i + 1 < argc)
+            outputFile = argv[++i];
+        else if (std::strcmp(argv[i], "--lights") == 0 && i + 1 < argc)
+            lightCount = std::atoi(argv[++i]);
+        else if (std::strcmp(argv[i], "--lighting") == 0 && i + 1 < argc)
+        {
+            i++;
+            if (std::strcmp(argv[i], "brute") == 0)
+                lightingMode = LightingMode::Brute;
+            else if (std::strcmp(argv[i], "volumes") == 0)
+                lightingMode = LightingMode::Volumes;
+            else
+                lightingMode = LightingMode::Clustered;
+        }
+        else if (std::strcmp(argv[i], "--no-cull") == 0)
+            frustumCulling = false;
+        else if (std::strcmp(argv[i], "--occlusion") == 0)
+            occlusionCulling = true;
+        else if (std::strcmp(argv[i], "--depth-prepass") == 0)
+            depthPrepass = true;
+        else if (std::strcmp(argv[i], "--gbuffer") == 0 && i + 1 < argc)
+            gBufferLayout = std::strcmp(argv[++i], "full") == 0 ? GBufferLayout::Full : GBufferLayout::Compact;
+        else if (std::strcmp(argv[i], "--bloom") == 0 && i + 1 < argc)
+            bloomMode = std::strcmp(argv[++i], "gaussian") == 0 ? BloomMode::Gaussian : BloomMode::MipChain;
+        else if (std::strcmp(argv[i], "--bloom-levels") == 0 && i + 1 < argc)
+            bloomLevels = std::atoi(argv[++i]);
+        else if (std::strcmp(argv[i], "--bloom-radius") == 0 && i + 1 < argc)
+            bloomRadius = (float)std::atof(argv[++i]);
+        else if (std::strcmp(argv[i], "--post") == 0 && i + 1 < argc)
+            postFilter = argv[++i];
+        else if (std::strcmp(argv[i], "--sharpness") == 0 && i + 1 < argc)
+            sharpness = (float)std::atof(argv[++i]);
+    }
+    if ((headless || benchmark) && frameLimit <= 0)
+        frameLimit = benchmark ? 600 : 300;
+    if (benchmark && warmupFrames <= 0)
+        warmupFrames = 30;
+    if (!benchmark)
+        warmupFrames = 0;
+    // ---------------
+
     // Init Cindow
     // -----------
-    Window window("LearnOpenGL", SCR_WIDTH, SCR_HEIGHT);
+    Window window("LearnOpenGL", SCR_WIDTH, SCR_HEIGHT, headless);
+    if (!window.isValid())
+        return -1;
     // -----------
 
     // Init Camera
@@ -66,27 +159,68 @@ int main()
     //depthShader.attachShader("src/shaders/Depthmap.geom", GL_GEOMETRY_SHADER);
     //depthShader.attachShader("src/shaders/Depthmap.frag", GL_FRAGMENT_SHADER);
     //depthShader.linkProgram();
+    std::string vertexFormatChunk = read_file("src/shaders/VertexFormat.glsl");
+    std::string gBufferChunk = read_file("src/shaders/GBuffer.glsl");
+    std::vector<const char*> gBufferDefines;
+    if (gBufferLayout == GBufferLayout::Compact)
+        gBufferDefines.push_back("#define COMPACT_GBUFFER\n");
+    gBufferDefines.push_back(gBufferChunk.c_str());
+    std::vector<const char*> geometryDefines = gBufferDefines;
+    if (depthPrepass)
+        geometryDefines.push_back("#define DEPTH_PREPASS\n");
     GLuint geometryShaders[2] = {
-        Shader::createShader("src/shaders/GBuffer.vert", GL_VERTEX_SHADER),
-        Shader::createShader("src/shaders/GBuffer.frag", GL_FRAGMENT_SHADER)
+        Shader::createShader("src/shaders/GBuffer.vert", GL_VERTEX_SHADER, { vertexFormatChunk.c_str() }),
+        Shader::createShader("src/shaders/GBuffer.frag", GL_FRAGMENT_SHADER, geometryDefines)
     };
     Shader shaderGeometryPass(2, geometryShaders);
 
+    std::vector<const char*> depthPrepassDefines = gBufferDefines;
+    depthPrepassDefines.push_back("#define DEPTH_ONLY\n");
+    GLuint depthPrepassShaders[2] = {
+        Shader::createShader("src/shaders/GBuffer.vert", GL_VERTEX_SHADER, { vertexFormatChunk.c_str() }),
+        Shader::createShader("src/shaders/GBuffer.frag", GL_FRAGMENT_SHADER, depthPrepassDefines)
+    };
+    Shader shaderDepthPrepass(2, depthPrepassShaders);
+
+    std::string lightingChunk = read_file("src/shaders/Lighting.glsl");
+    std::vector<const char*> lightingDefines = gBufferDefines;
+    if (lightingMode == LightingMode::Clustered)
+        lightingDefines.push_back("#define CLUSTERED\n");
+    lightingDefines.push_back(lightingChunk.c_str());
+    std::vector<const char*> lightVolumeDefines = gBufferDefines;
+    lightVolumeDefines.push_back(lightingChunk.c_str());
     GLuint lightingShaders[2] = {
         Shader::createShader("src/shaders/DeferredShading.vert", GL_VERTEX_SHADER),
-        Shader::createShader("src/shaders/DeferredShading.frag", GL_FRAGMENT_SHADER)
+        Shader::createShader("src/shaders/DeferredShading.frag", GL_FRAGMENT_SHADER, lightingDefines)
     };
     Shader shaderLightingPass(2, lightingShaders);
 
+    GLuint lightVolumeShaders[2] = {
+        Shader::createShader("src/shaders/LightVolume.vert", GL_VERTEX_SHADER),
+        Shader::createShader("src/shaders/LightVolume.frag", GL_FRAGMENT_SHADER, lightVolumeDefines)
+    };
+    Shader shaderLightVolume(2, lightVolumeShaders);
+
+    // Stencil-only pass for the light volumes, no fragment stage needed
+    GLuint lightStencilShaders[1] = {
+        Shader::createShader("src/shaders/LightVolume.vert", GL_VERTEX_SHADER)
+    };
+    Shader shaderLightStencil(1, lightStencilShaders);
+
     GLuint lightBoxShaders[2] = {
-        Shader::createShader("src/shaders/DeferredLightBox.vert", GL_VERTEX_SHADER),
+        Shader::createShader("src/shaders/DeferredLightBox.vert", GL_VERTEX_SHADER, { vertexFormatChunk.c_str() }),
         Shader::createShader("src/shaders/DeferredLightBox.frag", GL_FRAGMENT_SHADER)
     };
     Shader shaderLightBox(2, lightBoxShaders);
 
+    std::vector<const char*> postProcessingDefines;
+    if (std::strcmp(postFilter, "fxaa") == 0)
+        postProcessingDefines.push_back("#define FXAA\n");
+    else if (std::strcmp(postFilter, "sharpen") == 0)
+        postProcessingDefines.push_back("#define SHARPEN\n");
     GLuint postProcessingShaders[2] = {
         Shader::createShader("src/shaders/PostProcessing.vert", GL_VERTEX_SHADER),
-        Shader::createShader("src/shaders/PostProcessing.frag", GL_FRAGMENT_SHADER)
+        Shader::createShader("src/shaders/PostProcessing.frag", GL_FRAGMENT_SHADER, postProcessingDefines)
     };
     Shader shaderPostProcessing(2, postProcessingShaders);
 
@@ -95,6 +229,24 @@ int main()
         Shader::createShader("src/shaders/Blur.frag", GL_FRAGMENT_SHADER)
     };
     Shader shaderBlur(2, blurShaders);
+
+    GLuint bloomDownsampleShaders[2] = {
+        Shader::createShader("src/shaders/PostProcessing.vert", GL_VERTEX_SHADER),
+        Shader::createShader("src/shaders/BloomDownsample.frag", GL_FRAGMENT_SHADER)
+    };
+    Shader shaderBloomDownsample(2, bloomDownsampleShaders);
+
+    GLuint bloomUpsampleShaders[2] = {
+        Shader::createShader("src/shaders/PostProcessing.vert", GL_VERTEX_SHADER),
+        Shader::createShader("src/shaders/BloomUpsample.frag", GL_FRAGMENT_SHADER)
+    };
+    Shader shaderBloomUpsample(2, bloomUpsampleShaders);
+
+    GLuint hiZShaders[2] = {
+        Shader::createShader("src/shaders/PostProcessing.vert", GL_VERTEX_SHADER),
+        Shader::createShader("src/shaders/HiZ.frag", GL_FRAGMENT_SHADER, gBufferDefines)
+    };
+    Shader shaderHiZ(2, hiZShaders);
     // ------------
 
     // Init Textures
@@ -105,8 +257,13 @@ int main()
     //GLuint brick_specular = TextureFromFile("brickwall_specular.jpg", "Resources");
     //GLuint brick_diffuse = TextureFromFile("brickwall.jpg", "Resources");
     //GLuint brick_height = TextureFromFile("brickwall_disp.jpg", "Resources");
-    Model cube("Resources/cube/cube.obj");
-    Model backpack("Resources/cube/cube.obj");
+    AssetLoader assetLoader;
+    ModelRegistry models(&assetLoader);
+    // Loaded up front: it is tiny, the light boxes need it and it stands in
+    // for every model that is still streaming
+    ModelHandle cube = models.LoadNow("Resources/cube/cube.obj");
+    models.SetPlaceholder(cube);
+    ModelHandle backpack = models.Load("Resources/cube/cube.obj");
     std::vector<glm::vec3> objectPositions = {
         glm::vec3(-3.0,  -0.5, -3.0),
         glm::vec3(0.0,  -0.5, -3.0),
@@ -118,11 +275,11 @@ int main()
         glm::vec3(0.0,  -0.5,  3.0),
         glm::vec3(3.0,  -0.5,  3.0)
     };
+    SceneGraph scene;
     std::vector<Renderable> renderables;
     for (int i = 0; i < objectPositions.size(); i++)
     {
-        glm::mat4 model = glm::translate(glm::mat4(1.0), objectPositions[i]);
-        Transform transform(model);
+        Transform transform(scene, scene.CreateNode(objectPositions[i]));
         Renderable renderable(backpack, transform);
         renderables.push_back(renderable);
     }
@@ -130,10 +287,16 @@ int main()
     // -------------
     // Init Framebuffers
     // -----------------
-    Pipeline pipeline(window);
+    Pipeline pipeline(window, gBufferLayout);
+    pipeline.SetLightingMode(lightingMode);
+    pipeline.SetFrustumCulling(frustumCulling);
+    pipeline.SetOcclusionCulling(occlusionCulling);
+    pipeline.SetDepthPrepass(depthPrepass);
+    pipeline.SetBloomMode(bloomMode);
+    pipeline.SetBloomChain(bloomLevels < 1 ? 1 : (GLuint)bloomLevels, bloomRadius);
     Framebuffer deferredFBO;
-    deferredFBO.attachColorBuffers(2, window.getWidth(), window.getHeight());
-    deferredFBO.attachDepthBuffer(window.getWidth(), window.getHeight());
+    deferredFBO.attachColorBuffers(1, window.getWidth(), window.getHeight());
+    pipeline.ShareGBufferDepth(deferredFBO);
     // -----------------
 
     // Init VAOs
@@ -146,12 +309,11 @@ int main()
 
     // Init Lights
     // -----------
-    std::vector<PointLight> lights = initLights();
+    std::vector<PointLight> lights = initLights(lightCount);
     std::vector<Emissive> emissives;
     for (int i = 0; i < lights.size(); i++)
     {
-        glm::mat4 model = glm::translate(glm::mat4(1.0), lights[i].position);
-        Transform transform(model);
+        Transform transform(scene, scene.CreateNode(lights[i].position));
         transform.SetScale(glm::vec3(0.25f));
         Emissive emissive(cube, new PointLight(lights[i]), transform);
         emissives.push_back(emissive);
@@ -168,17 +330,34 @@ int main()
     // --------------------
     shaderLightingPass.use();
     shaderLightingPass.setInt("gPosition", 0);
+    shaderLightingPass.setInt("gDepth", 0);
     shaderLightingPass.setInt("gNormal", 1);
     shaderLightingPass.setInt("gAlbedoSpec", 2);
+    shaderLightingPass.setInt("lights", 3);
+    shaderLightingPass.setInt("clusterGrid", 4);
+    shaderLightingPass.setInt("clusterLights", 5);
+
+    shaderLightVolume.use();
+    shaderLightVolume.setInt("gPosition", 0);
+    shaderLightVolume.setInt("gDepth", 0);
+    shaderLightVolume.setInt("gNormal", 1);
+    shaderLightVolume.setInt("gAlbedoSpec", 2);
+    shaderLightVolume.setInt("lights", 3);
 
     shaderGeometryPass.use();
     shaderGeometryPass.setFloat("minLayers", 16.0f);
     shaderGeometryPass.setFloat("maxLayers", 64.0f);
     shaderGeometryPass.setFloat("heightScale", 0.025f);
-    shaderGeometryPass.setInt("material.texture_diffuse1", 0);
-    shaderGeometryPass.setInt("material.texture_normal1", 1);
-    shaderGeometryPass.setInt("material.texture_specular1", 2);
-    shaderGeometryPass.setInt("material.texture_height1", 3);
+    shaderGeometryPass.setInt("material.texture_diffuse1", (int)MaterialUnit::Diffuse);
+    shaderGeometryPass.setInt("material.texture_normal1", (int)MaterialUnit::Normal);
+    shaderGeometryPass.setInt("material.texture_specular1", (int)MaterialUnit::Specular);
+    shaderGeometryPass.setInt("material.texture_height1", (int)MaterialUnit::Height);
+
+    shaderDepthPrepass.use();
+    shaderDepthPrepass.setFloat("minLayers", 16.0f);
+    shaderDepthPrepass.setFloat("maxLayers", 64.0f);
+    shaderDepthPrepass.setFloat("heightScale", 0.025f);
+    shaderDepthPrepass.setInt("material.texture_height1", (int)MaterialUnit::Height);
 
     //shader.setFloat("far_plane", far_plane);
 
@@ -186,10 +365,22 @@ int main()
     shaderPostProcessing.setInt("scene_color", 0);
     shaderPostProcessing.setInt("scene_bloom", 1);
     shaderPostProcessing.setFloat("exposure", 0.01f);
+    shaderPostProcessing.setFloat("sharpness", sharpness);
 
     shaderBlur.use();
     shaderBlur.setInt("image", 0);
 
+    shaderBloomDownsample.use();
+    shaderBloomDownsample.setInt("image", 0);
+
+    shaderBloomUpsample.use();
+    shaderBloomUpsample.setInt("image", 0);
+
+    shaderHiZ.use();
+    shaderHiZ.setInt("gPosition", 0);
+    shaderHiZ.setInt("gDepth", 0);
+    shaderHiZ.setInt("gNormal", 1);
+
     //Shader::use(depthShader);
     //depthShader.setFloat("far_plane", far_plane);
     // --------------------
@@ -208,38 +399,86 @@ int main()
         pipeline.PushToEmissiveQueue(emissives[i]);
     }
 
+    // Init Benchmark
+    // --------------
+    // Benchmark mode replays a camera path with a fixed timestep so every run
+    // renders exactly the same frames, and reports per-pass timings as JSON.
+    Profiler profiler(warmupFrames);
+    CameraPath cameraPath, recordedPath;
+    if (benchmark)
+    {
+        if (cameraPathFile == NULL || !cameraPath.Load(cameraPathFile))
+            cameraPath = CameraPath::Orbit(glm::vec3(0.0f, -0.5f, 0.0f), 8.0f, 2.0f, (frameLimit + warmupFrames) * timestep);
+        pipeline.SetProfiler(&profiler);
+    }
+    // Measured runs must not depend on how fast assets happen to stream in
+    if (benchmark || headless)
+        assetLoader.Finish();
+    // --------------
+
     bool useNormal = true;
+    int frameCount = 0;
+    double startTime = window.getTime();
+    lastFrame = (float)startTime;
     while (!window.shouldClose())
     {
         //for (int i = 0; i < )
         // Per-frame Time Logic
         // --------------------
-        float currentFrame = (float)glfwGetTime();
-        deltaTime = currentFrame - lastFrame;
-        lastFrame = currentFrame;
+        if (benchmark)
+        {
+            deltaTime = timestep;
+            cameraPath.Apply(frameCount * timestep, camera);
+            profiler.BeginFrame();
+        }
+        else
+        {
+            float currentFrame = (float)window.getTime();
+            deltaTime = currentFrame - lastFrame;
+            lastFrame = currentFrame;
+        }
         // --------------------
         
         // Process Input
         // -------------
-        processInput(window, camera);
+        if (!benchmark)
+            processInput(window, camera);
         if (window.isKeyPressed(GLFW_KEY_T))
         {
             useNormal = !useNormal;
             shaderGeometryPass.use();
             shaderGeometryPass.setBool("useNormal", useNormal);
         }
+        if (recordFile != NULL)
+            recordedPath.Record((float)(window.getTime() - startTime), camera);
 
         // -------------
+        assetLoader.Update(UPLOAD_BUDGET_MS);
         pipeline.UpdateProjectionView(camera, window);
+        {
+            ProfileScope scope(benchmark ? &profiler : NULL, "SceneUpdate");
+            size_t updatedNodes = scene.Update();
+            if (benchmark)
+                profiler.SetCounter("scene_nodes_updated", (double)updatedNodes);
+        }
         // Render Stage
         // ------------
         Window::clear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+        pipeline.CullPass();
+        pipeline.DepthPrepass(camera, shaderDepthPrepass);
         pipeline.GeometryPass(window, camera, shaderGeometryPass);
-        pipeline.LightingPass(deferredFBO, camera, shaderLightingPass);
-        pipeline.BlitGBuffer(deferredFBO, window);
+        pipeline.OcclusionPass(shaderHiZ);
+        if (lightingMode == LightingMode::Volumes)
+            pipeline.LightVolumePass(deferredFBO, camera, shaderLightStencil, shaderLightVolume);
+        else
+            pipeline.LightingPass(deferredFBO, camera, shaderLightingPass);
         pipeline.LightGeometryPass(deferredFBO, shaderLightBox);
-        auto buffer = pipeline.BlurPass(deferredFBO, shaderBlur);
-        std::vector<GLuint> textures = { deferredFBO.colorBuffers[0], buffer.colorBuffers[0] };
+        GLuint bloom;
+        if (bloomMode == BloomMode::MipChain)
+            bloom = pipeline.BloomPass(deferredFBO, shaderBloomDownsample, shaderBloomUpsample);
+        else
+            bloom = pipeline.BlurPass(deferredFBO, shaderBlur).colorBuffers[0];
+        std::vector<GLuint> textures = { deferredFBO.colorBuffers[0], bloom };
         pipeline.FinalPass(textures, shaderPostProcessing);
         //// 1. Render depth map
         //// ------------------
@@ -318,15 +557,68 @@ int main()
         // check and call events and swap the buffers
         camera.update();
         window.update();
+        if (benchmark)
+        {
+            UniformStats uniformStats;
+            for (const Shader* shader : { &shaderGeometryPass, &shaderDepthPrepass, &shaderLightingPass, &shaderLightVolume, &shaderLightStencil, &shaderLightBox, &shaderBlur, &shaderBloomDownsample, &shaderBloomUpsample, &shaderPostProcessing, &shaderHiZ })
+            {
+                uniformStats.uploads += shader->getUniformStats().uploads;
+                uniformStats.skipped += shader->getUniformStats().skipped;
+                shader->resetUniformStats();
+            }
+            profiler.SetCounter("uniform_uploads", uniformStats.uploads);
+            profiler.SetCounter("uniform_uploads_skipped", uniformStats.skipped);
+            profiler.SetCounter("mesh_host_bytes_released", (double)models.GetReleasedBytes());
+            const TextureCache& textureCache = TextureCache::Get();
+            profiler.SetCounter("texture_cache_hits", (double)textureCache.GetHits());
+            profiler.SetCounter("texture_cache_misses", (double)textureCache.GetMisses());
+            profiler.SetCounter("texture_resident_count", (double)textureCache.GetResidentCount());
+            profiler.SetCounter("texture_resident_bytes", (double)textureCache.GetResidentBytes());
+            GeometryArena& geometryArena = GeometryArena::Get();
+            profiler.SetCounter("geometry_vao_binds", (double)geometryArena.GetBindCount());
+            profiler.SetCounter("geometry_pages", (double)geometryArena.GetPageCount());
+            profiler.SetCounter("geometry_bytes", (double)geometryArena.GetUsedBytes());
+            geometryArena.ResetBindCount();
+            profiler.SetCounter("gl_binds_issued", (double)GLState::GetStats().issued);
+            profiler.SetCounter("gl_binds_elided", (double)GLState::GetStats().elided);
+            GLState::ResetStats();
+            profiler.EndFrame();
+        }
+
+        if (frameLimit > 0 && ++frameCount >= frameLimit + warmupFrames)
+            window.close();
+    }
+
+    if (recordFile != NULL)
+        recordedPath.Save(recordFile);
+
+    if (benchmark)
+    {
+        profiler.Flush();
+        if (outputFile != NULL)
+        {
+            std::ofstream output(outputFile);
+            profiler.WriteJson(output, timestep);
+        }
+        else
+        {
+            profiler.WriteJson(std::cout, timestep);
+        }
+    }
+    else if (frameCount > 0)
+    {
+        double elapsed = window.getTime() - startTime;
+        std::cout << frameCount << " frames in " << elapsed << "s ("
+            << (elapsed * 1000.0 / frameCount) << " ms/frame)" << std::endl;
     }
     return 0;
 }
 
-std::vector<PointLight> initLights()
+std::vector<PointLight> initLights(GLsizei count)
 {
     srand(13);
     std::vector<PointLight> lights;
-    for (GLsizei i = 0; i < POINT_LIGHTS; i++)
+    for (GLsizei i = 0; i < count; i++)
     {
         float xPos = ((rand() % 100) / 100.0) * 6.0 - 3.0;
         float yPos = ((rand() % 100) / 100.0) * 6.0 - 4.0;
@@ -438,8 +730,7 @@ void drawPlane(const Shader& shader, const VertexArray& VAO, GLuint texture)
 {
     if (texture != 0)
     {
-        glActiveTexture(GL_TEXTURE0 + texture);
-        glBindTexture(GL_TEXTURE_2D, texture);
+        GLState::BindTexture(texture, GL_TEXTURE_2D, texture);
     }
 
     //if (normal != 0)
@@ -472,7 +763,7 @@ void drawSkybox(const Shader& shader, const VertexArray& VAO, GLuint texture)
 {
     if (texture != 0)
     {
-        glBindTexture(GL_TEXTURE_CUBE_MAP, texture);
+        GLState::BindTexture(GL_TEXTURE_CUBE_MAP, texture);
     }
     VAO.bind();
     shader.setMat4("model", glm::mat4(1.0));
@@ -482,14 +773,10 @@ void drawSkybox(const Shader& shader, const VertexArray& VAO, GLuint texture)
 
 void drawCubes(const Shader& shader, std::vector<glm::vec3> objectPositions, const VertexArray& VAO, GLuint diffuse, GLuint normal, GLuint specular, GLuint height)
 {
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, diffuse);
-    glActiveTexture(GL_TEXTURE1);
-    glBindTexture(GL_TEXTURE_2D, normal);
-    glActiveTexture(GL_TEXTURE2);
-    glBindTexture(GL_TEXTURE_2D, specular);
-    glActiveTexture(GL_TEXTURE3);
-    glBindTexture(GL_TEXTURE_2D, height);
+    GLState::BindTexture(0, GL_TEXTURE_2D, diffuse);
+    GLState::BindTexture(1, GL_TEXTURE_2D, normal);
+    GLState::BindTexture(2, GL_TEXTURE_2D, specular);
+    GLState::BindTexture(3, GL_TEXTURE_2D, height);
     VAO.bind();
     glm::mat4 model = glm::mat4(1.0f);
     for (GLsizei i = 0; i < objectPositions.size(); i++)
@@ -508,7 +795,7 @@ void drawWindows(const Shader& shader, const VertexArray& VAO, GLuint texture, s
     VAO.bind();
     if (texture != 0)
     {
-        glBindTexture(GL_TEXTURE_2D, texture);
+        GLState::BindTexture(GL_TEXTURE_2D, texture);
     }
     for (std::map<float, glm::vec3>::reverse_iterator it = sorted.rbegin(); it != sorted.rend(); ++it)
     {
@@ -548,7 +835,7 @@ GLuint loadSkybox(std::vector<std::string> faces)
 {
     GLuint textureID;
     glGenTextures(1, &textureID);
-    glBindTexture(GL_TEXTURE_CUBE_MAP, textureID);
+    GLState::BindTexture(GL_TEXTURE_CUBE_MAP, textureID);
 
     int width, height, nrChannels;
     for (int i = 0; i < faces.size(); i++)
@@ -595,7 +882,7 @@ GLuint loadTexture(char const* path)
         else if (nrChannels == 4)
             format = GL_RGBA;
 
-        glBindTexture(GL_TEXTURE_2D, textureID);
+        GLState::BindTexture(GL_TEXTURE_2D, textureID);
         glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
         glGenerateMipmap(GL_TEXTURE_2D);
 
@@ -0,0 +1,90 @@
+#include "camerapath.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+bool CameraPath::Load(const char* path)
+{
+    std::ifstream file(path);
+    if (!file)
+    {
+        std::cout << "Failed to open camera path: " << path << std::endl;
+        return false;
+    }
+
+    m_Keys.clear();
+    std::string line;
+    while (std::getline(file, line))
+    {
+        if (line.empty() || line[0] == '#')
+            continue;
+        std::istringstream stream(line);
+        CameraKey key;
+        if (stream >> key.time >> key.position.x >> key.position.y >> key.position.z >> key.yaw >> key.pitch)
+            m_Keys.push_back(key);
+    }
+    std::sort(m_Keys.begin(), m_Keys.end(), [](const CameraKey& a, const CameraKey& b) { return a.time < b.time; });
+    return !m_Keys.empty();
+}
+
+bool CameraPath::Save(const char* path) const
+{
+    std::ofstream file(path);
+    if (!file)
+    {
+        std::cout << "Failed to write camera path: " << path << std::endl;
+        return false;
+    }
+
+    file << "# time x y z yaw pitch\n";
+    for (const auto& key : m_Keys)
+        file << key.time << ' ' << key.position.x << ' ' << key.position.y << ' ' << key.position.z << ' ' << key.yaw << ' ' << key.pitch << '\n';
+    return true;
+}
+
+void CameraPath::Record(float time, const Camera& camera)
+{
+    m_Keys.push_back({ time, camera.Position, camera.Yaw, camera.Pitch });
+}
+
+void CameraPath::Apply(float time, Camera& camera) const
+{
+    if (m_Keys.empty())
+        return;
+
+    auto next = std::upper_bound(m_Keys.begin(), m_Keys.end(), time, [](float t, const CameraKey& key) { return t < key.time; });
+    const CameraKey& b = next == m_Keys.end() ? m_Keys.back() : *next;
+    const CameraKey& a = next == m_Keys.begin() ? b : *(next - 1);
+    float span = b.time - a.time;
+    float t = span > 0.0f ? (time - a.time) / span : 0.0f;
+
+    camera.Position = glm::mix(a.position, b.position, t);
+    camera.Yaw = a.yaw + (b.yaw - a.yaw) * t;
+    camera.Pitch = a.pitch + (b.pitch - a.pitch) * t;
+    camera.update();
+}
+
+CameraPath CameraPath::Orbit(glm::vec3 center, float radius, float height, float duration, int steps)
+{
+    CameraPath path;
+    for (int i = 0; i <= steps; i++)
+    {
+        float t = (float)i / steps;
+        float angle = t * 2.0f * 3.14159265f;
+        glm::vec3 position = center + glm::vec3(std::cos(angle) * radius, height, std::sin(angle) * radius);
+        glm::vec3 front = glm::normalize(center - position);
+
+        CameraKey key;
+        key.time = t * duration;
+        key.position = position;
+        // Keep yaw continuous so interpolation never spins the long way round
+        key.yaw = glm::degrees(angle) + 180.0f;
+        key.pitch = glm::degrees(std::asin(front.y));
+        path.m_Keys.push_back(key);
+    }
+    return path;
+}
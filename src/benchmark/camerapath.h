@@ -0,0 +1,28 @@
+#pragma once
+#include <glm/glm.hpp>
+#include <vector>
+#include "../camera/camera.h"
+
+struct CameraKey
+{
+    float time;
+    glm::vec3 position;
+    float yaw, pitch;
+};
+
+// A camera trajectory that can be recorded from the interactive loop, saved
+// as plain text ("time x y z yaw pitch" per line) and replayed by time.
+class CameraPath
+{
+private:
+    std::vector<CameraKey> m_Keys;
+public:
+    bool Load(const char* path);
+    bool Save(const char* path) const;
+    void Record(float time, const Camera& camera);
+    void Apply(float time, Camera& camera) const;
+    inline bool IsEmpty() const { return m_Keys.empty(); }
+    inline float GetDuration() const { return m_Keys.empty() ? 0.0f : m_Keys.back().time; }
+
+    static CameraPath Orbit(glm::vec3 center, float radius, float height, float duration, int steps = 64);
+};
@@ -0,0 +1,182 @@
+#include "profiler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+
+Profiler::Profiler(GLuint warmupFrames, GLuint latency)
+    : m_Slots(latency < 1 ? 1 : latency), m_WarmupFrames(warmupFrames)
+{
+}
+
+Profiler::~Profiler()
+{
+    for (auto& slot : m_Slots)
+    {
+        if (!slot.queryPool.empty())
+            glDeleteQueries((GLsizei)slot.queryPool.size(), slot.queryPool.data());
+    }
+}
+
+void Profiler::BeginFrame()
+{
+    FrameSlot& slot = m_Slots[m_Frame % m_Slots.size()];
+    // This slot was last used `latency` frames ago; its queries are done by now
+    resolve(slot);
+    slot.record = m_Frame >= m_WarmupFrames;
+    m_Open.clear();
+    Begin("Frame");
+}
+
+void Profiler::EndFrame()
+{
+    while (!m_Open.empty())
+        End();
+    m_Frame++;
+}
+
+void Profiler::Begin(const char* stage)
+{
+    FrameSlot& slot = m_Slots[m_Frame % m_Slots.size()];
+    Sample sample;
+    sample.stage = findStage(stage);
+    sample.queries[0] = acquireQuery(slot);
+    sample.queries[1] = acquireQuery(slot);
+    sample.cpuMs = 0.0;
+    glQueryCounter(sample.queries[0], GL_TIMESTAMP);
+    sample.cpuStart = Clock::now();
+    slot.samples.push_back(sample);
+    m_Open.push_back(slot.samples.size() - 1);
+}
+
+void Profiler::End()
+{
+    if (m_Open.empty())
+        return;
+    FrameSlot& slot = m_Slots[m_Frame % m_Slots.size()];
+    Sample& sample = slot.samples[m_Open.back()];
+    m_Open.pop_back();
+    sample.cpuMs = std::chrono::duration<double, std::milli>(Clock::now() - sample.cpuStart).count();
+    glQueryCounter(sample.queries[1], GL_TIMESTAMP);
+}
+
+void Profiler::SetCounter(const char* name, double value)
+{
+    if (m_Frame < m_WarmupFrames)
+        return;
+    for (auto& counter : m_Counters)
+    {
+        if (counter.name == name)
+        {
+            counter.values.push_back(value);
+            return;
+        }
+    }
+    m_Counters.push_back({ name, { value } });
+}
+
+void Profiler::Flush()
+{
+    // Oldest slot first so samples stay in frame order: after EndFrame the
+    // slot m_Frame would reuse next is the oldest, the one before it the newest
+    for (size_t i = 0; i < m_Slots.size(); i++)
+        resolve(m_Slots[(m_Frame + i) % m_Slots.size()]);
+}
+
+GLuint Profiler::GetRecordedFrames() const
+{
+    return m_Stages.empty() ? 0 : (GLuint)m_Stages[0].cpuMs.size();
+}
+
+size_t Profiler::findStage(const char* name)
+{
+    for (size_t i = 0; i < m_Stages.size(); i++)
+    {
+        if (m_Stages[i].name == name)
+            return i;
+    }
+    m_Stages.push_back({ name, {}, {} });
+    return m_Stages.size() - 1;
+}
+
+GLuint Profiler::acquireQuery(FrameSlot& slot)
+{
+    if (slot.used == slot.queryPool.size())
+    {
+        GLuint query;
+        glGenQueries(1, &query);
+        slot.queryPool.push_back(query);
+    }
+    return slot.queryPool[slot.used++];
+}
+
+void Profiler::resolve(FrameSlot& slot)
+{
+    if (slot.record)
+    {
+        for (const auto& sample : slot.samples)
+        {
+            GLuint64 start = 0, end = 0;
+            glGetQueryObjectui64v(sample.queries[0], GL_QUERY_RESULT, &start);
+            glGetQueryObjectui64v(sample.queries[1], GL_QUERY_RESULT, &end);
+            m_Stages[sample.stage].cpuMs.push_back(sample.cpuMs);
+            m_Stages[sample.stage].gpuMs.push_back((end - start) / 1000000.0);
+        }
+    }
+    slot.samples.clear();
+    slot.used = 0;
+    slot.record = false;
+}
+
+static void writeStats(std::ostream& out, const std::vector<double>& samples)
+{
+    std::vector<double> sorted(samples);
+    std::sort(sorted.begin(), sorted.end());
+    auto percentile = [&sorted](double p) {
+        if (sorted.empty())
+            return 0.0;
+        size_t rank = (size_t)std::ceil(p / 100.0 * sorted.size());
+        return sorted[std::min(std::max(rank, (size_t)1), sorted.size()) - 1];
+    };
+    double sum = 0.0;
+    for (double s : sorted)
+        sum += s;
+
+    out << "{ \"min\": " << (sorted.empty() ? 0.0 : sorted.front())
+        << ", \"avg\": " << (sorted.empty() ? 0.0 : sum / sorted.size())
+        << ", \"p50\": " << percentile(50.0)
+        << ", \"p95\": " << percentile(95.0)
+        << ", \"p99\": " << percentile(99.0)
+        << " }";
+}
+
+void Profiler::WriteJson(std::ostream& out, double timestep) const
+{
+    std::ios::fmtflags flags = out.flags();
+    out << std::fixed << std::setprecision(4);
+    out << "{\n";
+    out << "  \"frames\": " << GetRecordedFrames() << ",\n";
+    out << "  \"timestep\": " << timestep << ",\n";
+    out << "  \"stages\": {";
+    for (size_t i = 0; i < m_Stages.size(); i++)
+    {
+        out << (i == 0 ? "\n" : ",\n");
+        out << "    \"" << m_Stages[i].name << "\": {\n";
+        out << "      \"samples\": " << m_Stages[i].cpuMs.size() << ",\n";
+        out << "      \"cpu_ms\": ";
+        writeStats(out, m_Stages[i].cpuMs);
+        out << ",\n      \"gpu_ms\": ";
+        writeStats(out, m_Stages[i].gpuMs);
+        out << "\n    }";
+    }
+    out << "\n  },\n";
+    out << "  \"counters\": {";
+    for (size_t i = 0; i < m_Counters.size(); i++)
+    {
+        out << (i == 0 ? "\n" : ",\n");
+        out << "    \"" << m_Counters[i].name << "\": ";
+        writeStats(out, m_Counters[i].values);
+    }
+    out << "\n  }\n}\n";
+    out.flags(flags);
+}
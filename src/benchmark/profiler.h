@@ -0,0 +1,90 @@
+#pragma once
+#include <glad/glad.h>
+#include <chrono>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Collects per-stage CPU and GPU times over many frames.
+// GPU times come from GL_TIMESTAMP queries that are read back a few frames
+// later so the profiler never stalls the pipeline it is measuring.
+class Profiler
+{
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    struct Stage
+    {
+        std::string name;
+        std::vector<double> cpuMs;
+        std::vector<double> gpuMs;
+    };
+
+    // Per-frame CPU-side value such as a draw or upload count
+    struct Counter
+    {
+        std::string name;
+        std::vector<double> values;
+    };
+
+    struct Sample
+    {
+        size_t stage;
+        GLuint queries[2];
+        Clock::time_point cpuStart;
+        double cpuMs;
+    };
+
+    struct FrameSlot
+    {
+        std::vector<GLuint> queryPool;
+        std::vector<Sample> samples;
+        GLuint used = 0;
+        bool record = false;
+    };
+
+    std::vector<Stage> m_Stages;
+    std::vector<Counter> m_Counters;
+    std::vector<FrameSlot> m_Slots;
+    std::vector<size_t> m_Open;
+    GLuint m_Frame = 0;
+    GLuint m_WarmupFrames;
+public:
+    Profiler(GLuint warmupFrames = 0, GLuint latency = 4);
+    ~Profiler();
+
+    void BeginFrame();
+    void EndFrame();
+    void Begin(const char* stage);
+    void End();
+    // Records a value for the current frame; ignored during warmup
+    void SetCounter(const char* name, double value);
+    // Blocks until every outstanding query has been read back
+    void Flush();
+
+    GLuint GetRecordedFrames() const;
+    void WriteJson(std::ostream& out, double timestep) const;
+private:
+    size_t findStage(const char* name);
+    GLuint acquireQuery(FrameSlot& slot);
+    void resolve(FrameSlot& slot);
+};
+
+// Times the enclosing scope; a null profiler makes it a no-op.
+class ProfileScope
+{
+private:
+    Profiler* m_Profiler;
+public:
+    ProfileScope(Profiler* profiler, const char* stage)
+        : m_Profiler(profiler)
+    {
+        if (m_Profiler)
+            m_Profiler->Begin(stage);
+    }
+    ~ProfileScope()
+    {
+        if (m_Profiler)
+            m_Profiler->End();
+    }
+};
@@ -1,7 +1,8 @@
 #pragma once
 
-#include <glad\glad.h>
-#include <GLFW\glfw3.h>
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+#include "../utils/glstate.h"
 
 class Buffer
 {
@@ -11,28 +12,36 @@ private:
     GLuint m_BufferID;
     GLenum m_BufferType;
 public:
-    Buffer(GLenum bufferType, GLsizeiptr size, const void* data)
+    Buffer(GLenum bufferType, GLsizeiptr size, const void* data, GLenum usage = GL_STATIC_DRAW)
         :m_BufferType(bufferType)
     {
         glGenBuffers(1, &m_BufferID);
-        glBindBuffer(m_BufferType, m_BufferID);
-        glBufferData(m_BufferType, size, data, GL_STATIC_DRAW);
-        glBindBuffer(m_BufferType, 0);
+        GLState::BindBuffer(m_BufferType, m_BufferID);
+        glBufferData(m_BufferType, size, data, usage);
+        GLState::BindBuffer(m_BufferType, 0);
     }
     ~Buffer()
     {
-        glDeleteBuffers(1, &m_BufferID);
+        GLState::DeleteBuffers(1, &m_BufferID);
     }
-    inline void bind() const { glBindBuffer(m_BufferType, m_BufferID); }
+    inline void bind() const { GLState::BindBuffer(m_BufferType, m_BufferID); }
     inline void bindBufferRange(GLuint index, GLintptr offset, GLsizeiptr size) const 
     {
-        glBindBufferRange(m_BufferType, index, m_BufferID, offset, size);
+        GLState::BindBufferRange(m_BufferType, index, m_BufferID, offset, size);
     }
     inline void setBufferSubData(GLintptr offset, GLsizeiptr size, const void* data) const
     {
-        glBindBuffer(m_BufferType, m_BufferID);
+        GLState::BindBuffer(m_BufferType, m_BufferID);
         glBufferSubData(m_BufferType, offset, size, data);
-        glBindBuffer(m_BufferType, 0);
+        GLState::BindBuffer(m_BufferType, 0);
     }
-    inline void unbind() const { glBindBuffer(m_BufferType, 0); }
+    // Reallocates the storage, letting the driver orphan the old contents
+    inline void setBufferData(GLsizeiptr size, const void* data, GLenum usage) const
+    {
+        GLState::BindBuffer(m_BufferType, m_BufferID);
+        glBufferData(m_BufferType, size, data, usage);
+        GLState::BindBuffer(m_BufferType, 0);
+    }
+    inline void unbind() const { GLState::BindBuffer(m_BufferType, 0); }
+    inline GLuint getID() const { return m_BufferID; }
 };
@@ -1,6 +1,7 @@
 #pragma once
-#include <glad\glad.h>
+#include <glad/glad.h>
 #include <vector>
+#include "../utils/glstate.h"
 #ifdef _DEBUG
 #include <iostream>
 #endif
@@ -10,9 +11,12 @@ class Framebuffer
 public:
     GLuint ID;
     std::vector<GLuint> colorBuffers;
-    GLuint depthBuffer;
+    GLuint depthBuffer = 0;
+    // Set by attachDepthTexture, for passes that sample the depth
+    GLuint depthTexture = 0;
 private:
     std::vector<GLenum> m_DrawAttachments;
+    GLenum m_DepthAttachment = GL_DEPTH_ATTACHMENT;
 
 public:
     Framebuffer()
@@ -21,26 +25,32 @@ public:
     }
     static void bind(const GLuint framebufferID)
     {
-        glBindFramebuffer(GL_FRAMEBUFFER, framebufferID);
+        GLState::BindFramebuffer(GL_FRAMEBUFFER, framebufferID);
     }
     static void bindRead(GLuint framebufferID)
     {
-        glBindFramebuffer(GL_READ_FRAMEBUFFER, framebufferID);
+        GLState::BindFramebuffer(GL_READ_FRAMEBUFFER, framebufferID);
     }
     static void bindDraw(GLuint framebufferID)
     {
-        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, framebufferID);
+        GLState::BindFramebuffer(GL_DRAW_FRAMEBUFFER, framebufferID);
     }
     void attachColorBuffers(GLsizei count, GLsizei width, GLsizei height, GLenum internalformat = GL_RGBA16F)
     {
-        glBindFramebuffer(GL_FRAMEBUFFER, ID);
+        attachColorBuffers(std::vector<GLenum>(count, internalformat), width, height);
+    }
+    // One attachment per entry of internalformats, in order
+    void attachColorBuffers(const std::vector<GLenum>& internalformats, GLsizei width, GLsizei height)
+    {
+        GLState::BindFramebuffer(GL_FRAMEBUFFER, ID);
 
+        GLsizei count = (GLsizei)internalformats.size();
         std::vector<GLuint> buffers(count);
         glGenTextures(count, buffers.data());
         for (GLsizei i = 0; i < count; i++)
         {
-            glBindTexture(GL_TEXTURE_2D, buffers[i]);
-            glTexImage2D(GL_TEXTURE_2D, 0, internalformat, width, height, 0, GL_RGBA, GL_FLOAT, NULL);
+            GLState::BindTexture(GL_TEXTURE_2D, buffers[i]);
+            glTexImage2D(GL_TEXTURE_2D, 0, internalformats[i], width, height, 0, GL_RGBA, GL_FLOAT, NULL);
             glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
             glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
             glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
@@ -57,22 +67,86 @@ public:
             std::cout << "Framebuffer not complete" << std::endl;
 #endif
 
-        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        GLState::BindFramebuffer(GL_FRAMEBUFFER, 0);
     }
-    void attachDepthBuffer(GLsizei width, GLsizei height)
+    void attachDepthBuffer(GLsizei width, GLsizei height, GLenum internalformat = GL_DEPTH_COMPONENT)
     {
-        glBindFramebuffer(GL_FRAMEBUFFER, ID);
+        GLState::BindFramebuffer(GL_FRAMEBUFFER, ID);
 
+        bool stencil = internalformat == GL_DEPTH24_STENCIL8 || internalformat == GL_DEPTH32F_STENCIL8;
+        m_DepthAttachment = stencil ? GL_DEPTH_STENCIL_ATTACHMENT : GL_DEPTH_ATTACHMENT;
         glGenRenderbuffers(1, &depthBuffer);
         glBindRenderbuffer(GL_RENDERBUFFER, depthBuffer);
-        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT, width, height);
-        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depthBuffer);
+        glRenderbufferStorage(GL_RENDERBUFFER, internalformat, width, height);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, m_DepthAttachment, GL_RENDERBUFFER, depthBuffer);
+
+#ifdef _DEBUG
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            std::cout << "Framebuffer not complete" << std::endl;
+#endif
+        GLState::BindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
+    // Like attachDepthBuffer, but a texture that later passes can sample.
+    // Depth-stencil formats sample as depth.
+    void attachDepthTexture(GLsizei width, GLsizei height, GLenum internalformat = GL_DEPTH24_STENCIL8)
+    {
+        GLState::BindFramebuffer(GL_FRAMEBUFFER, ID);
+
+        bool stencil = internalformat == GL_DEPTH24_STENCIL8 || internalformat == GL_DEPTH32F_STENCIL8;
+        m_DepthAttachment = stencil ? GL_DEPTH_STENCIL_ATTACHMENT : GL_DEPTH_ATTACHMENT;
+        GLenum type = internalformat == GL_DEPTH24_STENCIL8 ? GL_UNSIGNED_INT_24_8
+            : internalformat == GL_DEPTH32F_STENCIL8 ? GL_FLOAT_32_UNSIGNED_INT_24_8_REV : GL_FLOAT;
+        glGenTextures(1, &depthTexture);
+        GLState::BindTexture(GL_TEXTURE_2D, depthTexture);
+        glTexImage2D(GL_TEXTURE_2D, 0, internalformat, width, height, 0, stencil ? GL_DEPTH_STENCIL : GL_DEPTH_COMPONENT, type, NULL);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, m_DepthAttachment, GL_TEXTURE_2D, depthTexture, 0);
+
+#ifdef _DEBUG
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            std::cout << "Framebuffer not complete" << std::endl;
+#endif
+        GLState::BindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
+
+    // Attaches source's color textures here too, in the same order, e.g. to
+    // draw into them with a different depth. source keeps ownership.
+    void shareColorBuffers(const Framebuffer& source)
+    {
+        GLState::BindFramebuffer(GL_FRAMEBUFFER, ID);
+
+        colorBuffers = source.colorBuffers;
+        m_DrawAttachments = source.m_DrawAttachments;
+        for (size_t i = 0; i < colorBuffers.size(); i++)
+            glFramebufferTexture2D(GL_FRAMEBUFFER, m_DrawAttachments[i], GL_TEXTURE_2D, colorBuffers[i], 0);
+        glDrawBuffers(m_DrawAttachments.size(), m_DrawAttachments.data());
+
+        GLState::BindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
+
+    // Attaches source's depth (renderbuffer or texture) here too, so both
+    // render against the same depth with no copy in between. source keeps
+    // ownership, and the sizes have to match.
+    void shareDepthBuffer(const Framebuffer& source)
+    {
+        GLState::BindFramebuffer(GL_FRAMEBUFFER, ID);
+
+        m_DepthAttachment = source.m_DepthAttachment;
+        depthBuffer = source.depthBuffer;
+        depthTexture = source.depthTexture;
+        if (depthTexture)
+            glFramebufferTexture2D(GL_FRAMEBUFFER, m_DepthAttachment, GL_TEXTURE_2D, depthTexture, 0);
+        else
+            glFramebufferRenderbuffer(GL_FRAMEBUFFER, m_DepthAttachment, GL_RENDERBUFFER, depthBuffer);
 
 #ifdef _DEBUG
         if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
             std::cout << "Framebuffer not complete" << std::endl;
 #endif
-        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        GLState::BindFramebuffer(GL_FRAMEBUFFER, 0);
     }
 
     static void blit(GLint srcX0, GLint srcY0, GLint srcX1, GLint srcY1, GLint dstX0, GLint dstY0, GLint dstX1, GLint dstY1, GLbitfield mask, GLenum filter)
@@ -1,7 +1,8 @@
 #pragma once
 
-#include <glad\glad.h>
-#include <GLFW\glfw3.h>
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+#include "../utils/glstate.h"
 
 class IndexBuffer
 {
@@ -13,15 +14,15 @@ public:
         : m_Count(count)
     {
         glGenBuffers(1, &m_BufferID);
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_BufferID);
+        GLState::BindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_BufferID);
         glBufferData(GL_ELEMENT_ARRAY_BUFFER, count * sizeof(GLushort), data, GL_STATIC_DRAW);
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+        GLState::BindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
     }
     ~IndexBuffer()
     {
-        glDeleteBuffers(1, &m_BufferID);
+        GLState::DeleteBuffers(1, &m_BufferID);
     }
-    inline void bind() const { glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_BufferID); }
-    static inline void unbind() { glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0); }
+    inline void bind() const { GLState::BindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_BufferID); }
+    static inline void unbind() { GLState::BindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0); }
     inline GLuint getCount() const { return m_Count; }
 };
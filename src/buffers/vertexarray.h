@@ -2,6 +2,7 @@
 #include <vector>
 #include <GLFW/glfw3.h>
 #include "buffer.h"
+#include "../utils/glstate.h"
 
 class VertexArray
 {
@@ -24,7 +25,7 @@ public:
             }
         }
 
-        glDeleteVertexArrays(1, &m_ArrayID);
+        GLState::DeleteVertexArrays(1, &m_ArrayID);
     }
 
     void addBuffer(Buffer* buffer, GLuint index, GLuint componentCount, GLsizei stride = 0, const void* start = 0)
@@ -41,6 +42,6 @@ public:
         buffer->unbind();
         VertexArray::unbind();
     }
-    inline void bind() const { glBindVertexArray(m_ArrayID); }
-    static inline void unbind() { glBindVertexArray(0); }
+    inline void bind() const { GLState::BindVertexArray(m_ArrayID); }
+    static inline void unbind() { GLState::BindVertexArray(0); }
 };
\ No newline at end of file
@@ -1,7 +1,7 @@
 #pragma once
 
-#include <glm\glm.hpp>
-#include <GLFW\glfw3.h>
+#include <glm/glm.hpp>
+#include <GLFW/glfw3.h>
 
 const float YAW = -90.0f;
 const float PITCH = 0.0f;
@@ -1,9 +1,8 @@
 #include "directionallight.h"
 
-void DirectionalLight::setShaderValues(const Shader* shader)
+void DirectionalLight::Pack(glm::vec4* texels) const
 {
-    shader->setVec3((name + ".ambient").c_str(), ambient);
-    shader->setVec3((name + ".diffuse").c_str(), diffuse);
-    shader->setVec3((name + ".specular").c_str(), specular);
-    shader->setVec3((name + ".direction").c_str(), direction);
+    texels[0] = glm::vec4(glm::normalize(direction), (float)LightType::Directional);
+    texels[1] = glm::vec4(color, 0.0f);
+    texels[2] = glm::vec4(ambient, 0.0f);
 }
@@ -1,16 +1,16 @@
 #pragma once
 #include <glm/glm.hpp>
-#include "../shaders/shader.h"
+#include "light.h"
 #include <string>
 
-struct DirectionalLight
+class DirectionalLight : public Light
 {
-    const std::string name;
-    glm::vec3 ambient;
-    glm::vec3 diffuse;
-    glm::vec3 specular;
+public:
     glm::vec3 direction;
-    DirectionalLight(const char* structName, glm::vec3 ambient, glm::vec3 diffuse, glm::vec3 specular, glm::vec3 direction)
-        : name(structName), ambient(ambient), diffuse(diffuse), specular(specular), direction(direction) {}
-    void setShaderValues(const Shader* shader);
-};
\ No newline at end of file
+
+    DirectionalLight(std::string structName, glm::vec3 ambient, glm::vec3 color, glm::vec3 direction)
+        : Light(structName, ambient, color), direction(direction) {}
+    virtual LightType GetType() const override { return LightType::Directional; }
+    virtual GLsizei GetTexelCount() const override { return 3; }
+    virtual void Pack(glm::vec4* texels) const override;
+};
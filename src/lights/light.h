@@ -4,6 +4,15 @@
 #include <string>
 #include <vector>
 #include "../shaders/shader.h"
+
+// Must match the LIGHT_* constants in DeferredShading.frag
+enum class LightType
+{
+    Point = 0,
+    Spot = 1,
+    Directional = 2
+};
+
 class Light
 {
 public:
@@ -28,5 +37,10 @@ public:
 
     /*virtual void UpdateShadowTransforms(glm::mat4 shadowProjection) = 0;*/
     /*virtual void SetDepthShaderValues(const Shader& shader) const = 0;*/
-    virtual void SetShaderValues(const Shader& shader) const = 0;
+    virtual LightType GetType() const = 0;
+    // Number of RGBA32F texels Pack writes; the first texel's w holds the type
+    virtual GLsizei GetTexelCount() const = 0;
+    virtual void Pack(glm::vec4* texels) const = 0;
+    // Sphere outside of which the light contributes nothing; false if unbounded
+    virtual bool GetBoundingSphere(glm::vec3& center, float& radius) const { return false; }
 };
\ No newline at end of file
@@ -0,0 +1,92 @@
+#pragma once
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <vector>
+
+#include "light.h"
+#include "../buffers/buffer.h"
+
+// Packs every light into one RGBA32F texture buffer read with texelFetch.
+// Records are variable length (see Light::Pack) and laid out back to back in
+// list order. Each frame the lights are repacked on the CPU and only the texel
+// range that differs from the last upload is sent to the GPU.
+class LightBuffer
+{
+private:
+    std::vector<glm::vec4> m_Texels;
+    std::vector<glm::vec4> m_Uploaded;
+    std::vector<GLint> m_Offsets;
+    Buffer* m_Buffer = NULL;
+    GLuint m_Texture;
+    size_t m_Capacity = 0;
+    GLint m_LightCount = 0;
+    GLsizeiptr m_UploadedBytes = 0;
+public:
+    LightBuffer()
+    {
+        glGenTextures(1, &m_Texture);
+    }
+    ~LightBuffer()
+    {
+        delete m_Buffer;
+        GLState::DeleteTextures(1, &m_Texture);
+    }
+
+    void Update(const std::vector<Light*>& lights)
+    {
+        m_Texels.clear();
+        m_Offsets.clear();
+        for (const auto& l : lights)
+        {
+            size_t offset = m_Texels.size();
+            m_Offsets.push_back((GLint)offset);
+            m_Texels.resize(offset + l->GetTexelCount());
+            l->Pack(&m_Texels[offset]);
+        }
+        m_LightCount = (GLint)lights.size();
+        m_UploadedBytes = 0;
+
+        if (m_Texels.size() > m_Capacity)
+            reserve(m_Texels.size());
+
+        // Find the dirty range; anything past the old size is new
+        size_t count = m_Texels.size();
+        size_t first = 0;
+        while (first < count && first < m_Uploaded.size() && m_Texels[first] == m_Uploaded[first])
+            first++;
+        size_t last = count;
+        while (last > first && last <= m_Uploaded.size() && m_Texels[last - 1] == m_Uploaded[last - 1])
+            last--;
+        if (first == last)
+            return;
+
+        m_UploadedBytes = (GLsizeiptr)((last - first) * sizeof(glm::vec4));
+        m_Buffer->setBufferSubData(first * sizeof(glm::vec4), m_UploadedBytes, &m_Texels[first]);
+        m_Uploaded = m_Texels;
+    }
+
+    void Bind(GLuint unit) const
+    {
+        GLState::BindTexture(unit, GL_TEXTURE_BUFFER, m_Texture);
+    }
+
+    inline GLint GetLightCount() const { return m_LightCount; }
+    // Texel offset of the i-th light's record
+    inline GLint GetOffset(size_t i) const { return m_Offsets[i]; }
+    inline GLsizeiptr GetUploadedBytes() const { return m_UploadedBytes; }
+private:
+    void reserve(size_t texels)
+    {
+        m_Capacity = m_Capacity < 64 ? 64 : m_Capacity;
+        while (m_Capacity < texels)
+            m_Capacity *= 2;
+
+        delete m_Buffer;
+        m_Buffer = new Buffer(GL_TEXTURE_BUFFER, m_Capacity * sizeof(glm::vec4), NULL, GL_DYNAMIC_DRAW);
+        GLState::BindTexture(GL_TEXTURE_BUFFER, m_Texture);
+        glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, m_Buffer->getID());
+        GLState::BindTexture(GL_TEXTURE_BUFFER, 0);
+        // The new storage is empty, so everything has to go up again
+        m_Uploaded.clear();
+    }
+};
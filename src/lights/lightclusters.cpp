@@ -0,0 +1,209 @@
+#include "lightclusters.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+LightClusters::LightClusters(ThreadPool* threadPool)
+    : m_ThreadPool(threadPool), m_SliceIndices(SLICES), m_Grid(CLUSTER_COUNT),
+    m_GridBuffer(GL_TEXTURE_BUFFER, CLUSTER_COUNT * sizeof(glm::uvec2), NULL, GL_DYNAMIC_DRAW),
+    m_IndexBuffer(GL_TEXTURE_BUFFER, sizeof(GLuint), NULL, GL_DYNAMIC_DRAW)
+{
+    glGenTextures(2, m_Textures);
+    GLState::BindTexture(GL_TEXTURE_BUFFER, m_Textures[0]);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_RG32UI, m_GridBuffer.getID());
+    GLState::BindTexture(GL_TEXTURE_BUFFER, m_Textures[1]);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_R32UI, m_IndexBuffer.getID());
+    GLState::BindTexture(GL_TEXTURE_BUFFER, 0);
+}
+
+LightClusters::~LightClusters()
+{
+    GLState::DeleteTextures(2, m_Textures);
+}
+
+// Conservative NDC extent of a sphere along one view axis.
+// c is the centre's coordinate on that axis, depth its distance in front of
+// the camera and scale the matching projection term (P[0][0] or P[1][1]).
+// The two tangents from the eye bound the sphere; a tangent that points
+// behind the eye leaves that side unbounded.
+static void projectSphereAxis(float c, float depth, float radius, float scale, float& lo, float& hi)
+{
+    lo = -1.0f;
+    hi = 1.0f;
+    float lengthSq = c * c + depth * depth;
+    if (lengthSq <= radius * radius)
+        return;
+    float length = std::sqrt(lengthSq);
+    float cosT = std::sqrt(lengthSq - radius * radius) / length;
+    float sinT = radius / length;
+
+    float c0 = c * cosT - depth * sinT;
+    float d0 = c * sinT + depth * cosT;
+    float c1 = c * cosT + depth * sinT;
+    float d1 = depth * cosT - c * sinT;
+    if (d0 > 0.0f)
+        lo = std::max(lo, scale * c0 / d0);
+    if (d1 > 0.0f)
+        hi = std::min(hi, scale * c1 / d1);
+}
+
+void LightClusters::Build(const std::vector<Light*>& lights, const LightBuffer& lightBuffer, const glm::mat4& view, const glm::mat4& projection, float nearPlane, float farPlane)
+{
+    m_SliceScale = SLICES / std::log(farPlane / nearPlane);
+    m_SliceBias = -std::log(nearPlane) * m_SliceScale;
+
+    // 1. Project every light to a tile rectangle and slice range
+    // ----------------------------------------------------------
+    m_Bounds.resize(lights.size());
+    m_Visible.resize(lights.size());
+    auto bounds = [&](size_t begin, size_t end) {
+        computeBounds(begin, end, lights, lightBuffer, view, projection, nearPlane, farPlane);
+    };
+    if (m_ThreadPool)
+        m_ThreadPool->ParallelFor(lights.size(), bounds, 64);
+    else
+        bounds(0, lights.size());
+
+    m_GlobalLights.clear();
+    for (size_t i = 0; i < lights.size(); i++)
+    {
+        if (m_Visible[i] == 2)
+            m_GlobalLights.push_back(m_Bounds[i].offset);
+    }
+
+    // 2. Bin lights per slice; slices are independent so they run in parallel
+    // ------------------------------------------------------------------------
+    auto bin = [this](size_t begin, size_t end) {
+        for (size_t s = begin; s < end; s++)
+            binSlice((GLuint)s);
+    };
+    if (m_ThreadPool)
+        m_ThreadPool->ParallelFor(SLICES, bin);
+    else
+        bin(0, SLICES);
+
+    // 3. Concatenate the slice lists behind the global lights
+    // -------------------------------------------------------
+    size_t total = m_GlobalLights.size();
+    for (GLuint s = 0; s < SLICES; s++)
+    {
+        for (GLuint t = 0; t < TILES_X * TILES_Y; t++)
+            m_Grid[s * TILES_X * TILES_Y + t].x += (GLuint)total;
+        total += m_SliceIndices[s].size();
+    }
+    m_Indices.resize(total);
+    size_t offset = 0;
+    if (!m_GlobalLights.empty())
+        std::memcpy(&m_Indices[offset], m_GlobalLights.data(), m_GlobalLights.size() * sizeof(GLuint));
+    offset += m_GlobalLights.size();
+    for (GLuint s = 0; s < SLICES; s++)
+    {
+        if (!m_SliceIndices[s].empty())
+            std::memcpy(&m_Indices[offset], m_SliceIndices[s].data(), m_SliceIndices[s].size() * sizeof(GLuint));
+        offset += m_SliceIndices[s].size();
+    }
+
+    m_GridBuffer.setBufferSubData(0, CLUSTER_COUNT * sizeof(glm::uvec2), m_Grid.data());
+    if (m_Indices.empty())
+        m_IndexBuffer.setBufferData(sizeof(GLuint), NULL, GL_DYNAMIC_DRAW);
+    else
+        m_IndexBuffer.setBufferData(m_Indices.size() * sizeof(GLuint), m_Indices.data(), GL_DYNAMIC_DRAW);
+}
+
+void LightClusters::computeBounds(size_t begin, size_t end, const std::vector<Light*>& lights, const LightBuffer& lightBuffer, const glm::mat4& view, const glm::mat4& projection, float nearPlane, float farPlane)
+{
+    auto sliceIndex = [this](float z) {
+        return std::min(std::max((GLint)(std::log(z) * m_SliceScale + m_SliceBias), 0), (GLint)SLICES - 1);
+    };
+    auto tileIndex = [](float ndc, GLuint tiles) {
+        return std::min(std::max((GLint)((ndc * 0.5f + 0.5f) * tiles), 0), (GLint)tiles - 1);
+    };
+
+    for (size_t i = begin; i < end; i++)
+    {
+        LightBounds& b = m_Bounds[i];
+        b.offset = (GLuint)lightBuffer.GetOffset(i);
+
+        glm::vec3 center;
+        float radius;
+        if (!lights[i]->GetBoundingSphere(center, radius))
+        {
+            m_Visible[i] = 2;
+            continue;
+        }
+
+        glm::vec3 p = glm::vec3(view * glm::vec4(center, 1.0f));
+        float depth = -p.z;
+        m_Visible[i] = 0;
+        if (depth + radius < nearPlane || depth - radius > farPlane)
+            continue;
+
+        float xMin, xMax, yMin, yMax;
+        projectSphereAxis(p.x, depth, radius, projection[0][0], xMin, xMax);
+        projectSphereAxis(p.y, depth, radius, projection[1][1], yMin, yMax);
+        if (xMin > xMax || yMin > yMax)
+            continue;
+
+        b.tileMin = glm::ivec2(tileIndex(xMin, TILES_X), tileIndex(yMin, TILES_Y));
+        b.tileMax = glm::ivec2(tileIndex(xMax, TILES_X), tileIndex(yMax, TILES_Y));
+        b.sliceMin = sliceIndex(std::max(depth - radius, nearPlane));
+        b.sliceMax = sliceIndex(std::min(depth + radius, farPlane));
+        m_Visible[i] = 1;
+    }
+}
+
+void LightClusters::binSlice(GLuint slice)
+{
+    // Counting sort into this slice's tiles so every cluster's list is contiguous
+    glm::uvec2* grid = &m_Grid[slice * TILES_X * TILES_Y];
+    for (GLuint t = 0; t < TILES_X * TILES_Y; t++)
+        grid[t] = glm::uvec2(0);
+
+    for (size_t i = 0; i < m_Bounds.size(); i++)
+    {
+        const LightBounds& b = m_Bounds[i];
+        if (m_Visible[i] != 1 || (GLint)slice < b.sliceMin || (GLint)slice > b.sliceMax)
+            continue;
+        for (GLint y = b.tileMin.y; y <= b.tileMax.y; y++)
+            for (GLint x = b.tileMin.x; x <= b.tileMax.x; x++)
+                grid[y * TILES_X + x].y++;
+    }
+
+    GLuint offset = 0;
+    for (GLuint t = 0; t < TILES_X * TILES_Y; t++)
+    {
+        grid[t].x = offset;
+        offset += grid[t].y;
+        grid[t].y = 0;
+    }
+
+    std::vector<GLuint>& indices = m_SliceIndices[slice];
+    indices.resize(offset);
+    for (size_t i = 0; i < m_Bounds.size(); i++)
+    {
+        const LightBounds& b = m_Bounds[i];
+        if (m_Visible[i] != 1 || (GLint)slice < b.sliceMin || (GLint)slice > b.sliceMax)
+            continue;
+        for (GLint y = b.tileMin.y; y <= b.tileMax.y; y++)
+        {
+            for (GLint x = b.tileMin.x; x <= b.tileMax.x; x++)
+            {
+                glm::uvec2& cluster = grid[y * TILES_X + x];
+                indices[cluster.x + cluster.y++] = b.offset;
+            }
+        }
+    }
+}
+
+void LightClusters::Bind(GLuint gridUnit, GLuint indexUnit) const
+{
+    GLState::BindTexture(gridUnit, GL_TEXTURE_BUFFER, m_Textures[0]);
+    GLState::BindTexture(indexUnit, GL_TEXTURE_BUFFER, m_Textures[1]);
+}
+
+void LightClusters::SetShaderValues(const Shader& shader) const
+{
+    shader.setVec2("clusterDepth", glm::vec2(m_SliceScale, m_SliceBias));
+    shader.setInt("globalLightCount", (int)m_GlobalLights.size());
+}
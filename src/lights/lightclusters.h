@@ -0,0 +1,61 @@
+#pragma once
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <vector>
+
+#include "light.h"
+#include "lightbuffer.h"
+#include "../buffers/buffer.h"
+#include "../shaders/shader.h"
+#include "../utils/threadpool.h"
+
+// Bins lights into a froxel grid (screen tiles x exponential depth slices) on
+// the CPU so the lighting shader only visits lights that can reach a pixel.
+//
+// GPU layout, both texture buffers:
+//   clusterGrid   RG32UI, one (offset, count) pair per cluster into clusterLights
+//   clusterLights R32UI, texel offsets of light records in the LightBuffer.
+//                 The first globalLightCount entries are unbounded lights
+//                 (directional) that apply to every cluster.
+class LightClusters
+{
+public:
+    static const GLuint TILES_X = 16;
+    static const GLuint TILES_Y = 9;
+    static const GLuint SLICES = 24;
+    static const GLuint CLUSTER_COUNT = TILES_X * TILES_Y * SLICES;
+private:
+    struct LightBounds
+    {
+        GLuint offset;
+        glm::ivec2 tileMin, tileMax;
+        GLint sliceMin, sliceMax;
+    };
+
+    ThreadPool* m_ThreadPool;
+    std::vector<LightBounds> m_Bounds;
+    std::vector<char> m_Visible;
+    std::vector<GLuint> m_GlobalLights;
+    std::vector<std::vector<GLuint>> m_SliceIndices;
+    std::vector<glm::uvec2> m_Grid;
+    std::vector<GLuint> m_Indices;
+
+    Buffer m_GridBuffer;
+    Buffer m_IndexBuffer;
+    GLuint m_Textures[2];
+    float m_SliceScale = 0.0f;
+    float m_SliceBias = 0.0f;
+public:
+    LightClusters(ThreadPool* threadPool = NULL);
+    ~LightClusters();
+
+    void Build(const std::vector<Light*>& lights, const LightBuffer& lightBuffer, const glm::mat4& view, const glm::mat4& projection, float nearPlane, float farPlane);
+    void Bind(GLuint gridUnit, GLuint indexUnit) const;
+    void SetShaderValues(const Shader& shader) const;
+
+    // Total light references across all clusters, for reporting
+    inline size_t GetIndexCount() const { return m_Indices.size(); }
+private:
+    void computeBounds(size_t begin, size_t end, const std::vector<Light*>& lights, const LightBuffer& lightBuffer, const glm::mat4& view, const glm::mat4& projection, float nearPlane, float farPlane);
+    void binSlice(GLuint slice);
+};
@@ -1,5 +1,7 @@
 #include "pointlight.h"
 
+#include <cmath>
+
 PointLight::PointLight(std::string structName, glm::vec3 ambient, glm::vec3 color, glm::vec3 position)
     : Light(structName, ambient, color), position(position), radius(getRadius())
 {
@@ -26,17 +28,15 @@ PointLight::PointLight(std::string structName, glm::vec3 ambient, glm::vec3 colo
 
 float PointLight::getRadius() const
 {
-    float I = std::fmaxf(std::fmaxf(color.r * 0.2126f, color.g * 0.7152f), color.b * 0.0722f);
-    return std::sqrtf(4.0f * I * (256.0f / 5.0f)) / 2.0f;
+    float I = std::fmax(std::fmax(color.r * 0.2126f, color.g * 0.7152f), color.b * 0.0722f);
+    return std::sqrt(4.0f * I * (256.0f / 5.0f)) / 2.0f;
 }
 
-void PointLight::SetShaderValues(const Shader& shader) const
+void PointLight::Pack(glm::vec4* texels) const
 {
-    shader.setVec3((name + ".Ambient").c_str(), ambient);
-    shader.setVec3((name + ".Color").c_str(), color);
-    shader.setVec3((name + ".Position").c_str(), position);
-    shader.setFloat((name + ".Linear").c_str(), linear);
-    shader.setFloat((name + ".Quadratic").c_str(), quadratic);
+    texels[0] = glm::vec4(position, (float)LightType::Point);
+    texels[1] = glm::vec4(color, radius);
+    texels[2] = glm::vec4(ambient, 0.0f);
     //shader.setInt((name + ".ShadowMap").c_str(), depthCubemap);
     //glActiveTexture(GL_TEXTURE0 + depthCubemap);
     //glBindTexture(GL_TEXTURE_CUBE_MAP, depthCubemap);
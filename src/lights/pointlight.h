@@ -13,7 +13,15 @@ public:
     const float quadratic = 1.8;
 
     PointLight(std::string structName, glm::vec3 ambient, glm::vec3 color, glm::vec3 position);
-    virtual void SetShaderValues(const Shader& shader) const override;
+    virtual LightType GetType() const override { return LightType::Point; }
+    virtual GLsizei GetTexelCount() const override { return 3; }
+    virtual void Pack(glm::vec4* texels) const override;
+    virtual bool GetBoundingSphere(glm::vec3& center, float& radius) const override
+    {
+        center = position;
+        radius = this->radius;
+        return true;
+    }
     /*void SetDepthShaderValues(const Shader& shader) const;*/
     //void UpdateShadowTransforms(glm::mat4 shadowProjection)
     //{
@@ -1,15 +1,22 @@
 #include "spotlight.h"
 
-void SpotLight::setShaderValues(const Shader* shader)
+#include <cmath>
+
+// Distance at which the attenuated intensity drops below 5/256, same cutoff as PointLight
+float SpotLight::getRadius() const
+{
+    float I = std::fmax(std::fmax(color.r * 0.2126f, color.g * 0.7152f), color.b * 0.0722f);
+    float c = k1 - I * (256.0f / 5.0f);
+    if (k3 <= 0.0f)
+        return k2 > 0.0f ? std::fmax(-c / k2, 0.0f) : 0.0f;
+    return std::fmax((-k2 + std::sqrt(k2 * k2 - 4.0f * k3 * c)) / (2.0f * k3), 0.0f);
+}
+
+void SpotLight::Pack(glm::vec4* texels) const
 {
-    shader->setVec3((name + ".ambient").c_str(), ambient);
-    shader->setVec3((name + ".diffuse").c_str(), diffuse);
-    shader->setVec3((name + ".specular").c_str(), specular);
-    shader->setVec3((name + ".position").c_str(), position);
-    shader->setVec3((name + ".direction").c_str(), direction);
-    shader->setFloat((name + ".constant").c_str(), k1);
-    shader->setFloat((name + ".linear").c_str(), k2);
-    shader->setFloat((name + ".quadratic").c_str(), k3);
-    shader->setFloat((name + ".cutOff").c_str(), cutOff);
-    shader->setFloat((name + ".outerCutOff").c_str(), outerCutOff);
+    texels[0] = glm::vec4(position, (float)LightType::Spot);
+    texels[1] = glm::vec4(color, radius);
+    texels[2] = glm::vec4(ambient, 0.0f);
+    texels[3] = glm::vec4(glm::normalize(direction), cutOff);
+    texels[4] = glm::vec4(k1, k2, k3, outerCutOff);
 }
@@ -1,22 +1,32 @@
 #pragma once
 #include <string>
 #include <glm/glm.hpp>
-#include "../shaders/shader.h"
-struct SpotLight
+#include "light.h"
+
+class SpotLight : public Light
 {
-    const std::string name;
-    glm::vec3 ambient;
-    glm::vec3 diffuse;
-    glm::vec3 specular;
+public:
     glm::vec3 position;
     glm::vec3 direction;
     float k1;
     float k2;
     float k3;
+    // Cosines of the inner and outer cone angles
     float cutOff;
     float outerCutOff;
+    const float radius;
 
-    SpotLight(const char* structName, glm::vec3 ambient, glm::vec3 diffuse, glm::vec3 specular, glm::vec3 position, glm::vec3 direction, float k1, float k2, float k3, float cutOff, float outerCutoff)
-        : name(structName), ambient(ambient), diffuse(diffuse), specular(specular), position(position), direction(direction), k1(k1), k2(k2), k3(k3), cutOff(cutOff), outerCutOff(outerCutoff) {}
-    void setShaderValues(const Shader* shader);
-};
\ No newline at end of file
+    SpotLight(std::string structName, glm::vec3 ambient, glm::vec3 color, glm::vec3 position, glm::vec3 direction, float k1, float k2, float k3, float cutOff, float outerCutoff)
+        : Light(structName, ambient, color), position(position), direction(direction), k1(k1), k2(k2), k3(k3), cutOff(cutOff), outerCutOff(outerCutoff), radius(getRadius()) {}
+    virtual LightType GetType() const override { return LightType::Spot; }
+    virtual GLsizei GetTexelCount() const override { return 5; }
+    virtual void Pack(glm::vec4* texels) const override;
+    virtual bool GetBoundingSphere(glm::vec3& center, float& radius) const override
+    {
+        center = position;
+        radius = this->radius;
+        return true;
+    }
+private:
+    float getRadius() const;
+};
@@ -0,0 +1,188 @@
+#include "geometryarena.h"
+#include "mesh.h"
+
+#include <algorithm>
+#include <cstddef>
+#include "../utils/glstate.h"
+
+GeometryArena& GeometryArena::Get()
+{
+    static GeometryArena arena;
+    return arena;
+}
+
+GeometryAllocation GeometryArena::Allocate(const void* vertices, GLsizei vertexCount, const void* indices, size_t indexBytes)
+{
+    GeometryAllocation allocation;
+    size_t vertexOffset = 0, indexOffset = 0;
+    for (GLuint p = 0; p < m_Pages.size() && !allocation.isValid(); p++)
+    {
+        Page& page = m_Pages[p];
+        if (page.VAO == 0 || !take(page.freeVertices, (size_t)vertexCount, 1, vertexOffset))
+            continue;
+        // Aligned for GL_UNSIGNED_INT, which also covers GL_UNSIGNED_SHORT
+        if (!take(page.freeIndices, indexBytes, sizeof(GLuint), indexOffset))
+        {
+            give(page.freeVertices, vertexOffset, (size_t)vertexCount);
+            continue;
+        }
+        allocation.page = p;
+    }
+    if (!allocation.isValid())
+    {
+        allocation.page = createPage(std::max((size_t)PAGE_VERTICES, (size_t)vertexCount), std::max((size_t)PAGE_INDEX_BYTES, indexBytes));
+        Page& page = m_Pages[allocation.page];
+        take(page.freeVertices, (size_t)vertexCount, 1, vertexOffset);
+        take(page.freeIndices, indexBytes, sizeof(GLuint), indexOffset);
+    }
+
+    Page& page = m_Pages[allocation.page];
+    page.allocations++;
+    allocation.baseVertex = (GLint)vertexOffset;
+    allocation.vertexCount = vertexCount;
+    allocation.indexOffset = indexOffset;
+    allocation.indexBytes = indexBytes;
+    m_UsedBytes += (size_t)vertexCount * sizeof(PackedVertex) + indexBytes;
+
+    // The element buffer binding is VAO state, so it goes through the page's VAO
+    Bind(allocation.page);
+    GLState::BindBuffer(GL_ARRAY_BUFFER, page.VBO);
+    glBufferSubData(GL_ARRAY_BUFFER, vertexOffset * sizeof(PackedVertex), (size_t)vertexCount * sizeof(PackedVertex), vertices);
+    GLState::BindBuffer(GL_ARRAY_BUFFER, 0);
+    glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, indexOffset, indexBytes, indices);
+    Unbind();
+    return allocation;
+}
+
+void GeometryArena::Free(GeometryAllocation& allocation)
+{
+    if (!allocation.isValid())
+        return;
+
+    Page& page = m_Pages[allocation.page];
+    give(page.freeVertices, (size_t)allocation.baseVertex, (size_t)allocation.vertexCount);
+    give(page.freeIndices, allocation.indexOffset, allocation.indexBytes);
+    m_UsedBytes -= (size_t)allocation.vertexCount * sizeof(PackedVertex) + allocation.indexBytes;
+    if (--page.allocations == 0)
+    {
+        // Empty pages go straight away, so nothing is left by the time the
+        // context is destroyed; the slot is reused by the next new page
+        GLState::DeleteVertexArrays(1, &page.VAO);
+        GLState::DeleteBuffers(1, &page.VBO);
+        GLState::DeleteBuffers(1, &page.EBO);
+        page = Page();
+    }
+    allocation = GeometryAllocation();
+}
+
+void GeometryArena::Bind(GLuint page)
+{
+    if (GLState::BindVertexArray(m_Pages[page].VAO))
+        m_BindCount++;
+}
+
+void GeometryArena::Unbind()
+{
+    GLState::BindVertexArray(0);
+}
+
+size_t GeometryArena::GetPageCount() const
+{
+    size_t count = 0;
+    for (const auto& page : m_Pages)
+        if (page.VAO != 0)
+            count++;
+    return count;
+}
+
+GLuint GeometryArena::createPage(size_t vertexCapacity, size_t indexCapacity)
+{
+    GLuint index = 0;
+    while (index < m_Pages.size() && m_Pages[index].VAO != 0)
+        index++;
+    if (index == m_Pages.size())
+        m_Pages.emplace_back();
+
+    Page& page = m_Pages[index];
+    page.vertexCapacity = vertexCapacity;
+    page.indexCapacity = indexCapacity;
+    page.freeVertices.push_back({ 0, vertexCapacity });
+    page.freeIndices.push_back({ 0, indexCapacity });
+
+    glGenVertexArrays(1, &page.VAO);
+    glGenBuffers(1, &page.VBO);
+    glGenBuffers(1, &page.EBO);
+
+    GLState::BindVertexArray(page.VAO);
+    GLState::BindBuffer(GL_ARRAY_BUFFER, page.VBO);
+    glBufferData(GL_ARRAY_BUFFER, vertexCapacity * sizeof(PackedVertex), NULL, GL_STATIC_DRAW);
+    GLState::BindBuffer(GL_ELEMENT_ARRAY_BUFFER, page.EBO);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexCapacity, NULL, GL_STATIC_DRAW);
+
+    // vertex positions;
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 3, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, Position));
+
+    // normals
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 4, GL_INT_2_10_10_10_REV, GL_TRUE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, Normal));
+    // texcoords
+    glEnableVertexAttribArray(2);
+    glVertexAttribPointer(2, 2, GL_HALF_FLOAT, GL_FALSE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, TexCoords));
+    // tangent + bitangent sign
+    glEnableVertexAttribArray(3);
+    glVertexAttribPointer(3, 4, GL_INT_2_10_10_10_REV, GL_TRUE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, Tangent));
+
+    GLState::BindVertexArray(0);
+    GLState::BindBuffer(GL_ARRAY_BUFFER, 0);
+    return index;
+}
+
+// First fit; offsets are rounded up to alignment and whatever is skipped stays free
+bool GeometryArena::take(std::vector<Range>& freeList, size_t size, size_t alignment, size_t& offset)
+{
+    for (size_t i = 0; i < freeList.size(); i++)
+    {
+        Range& range = freeList[i];
+        size_t aligned = (range.offset + alignment - 1) / alignment * alignment;
+        size_t padding = aligned - range.offset;
+        if (range.size < padding + size)
+            continue;
+
+        offset = aligned;
+        Range after = { aligned + size, range.size - padding - size };
+        if (padding > 0)
+        {
+            range.size = padding;
+            if (after.size > 0)
+                freeList.insert(freeList.begin() + i + 1, after);
+        }
+        else if (after.size > 0)
+            range = after;
+        else
+            freeList.erase(freeList.begin() + i);
+        return true;
+    }
+    return false;
+}
+
+void GeometryArena::give(std::vector<Range>& freeList, size_t offset, size_t size)
+{
+    if (size == 0)
+        return;
+    auto next = std::lower_bound(freeList.begin(), freeList.end(), offset,
+        [](const Range& r, size_t o) { return r.offset < o; });
+    next = freeList.insert(next, { offset, size });
+
+    // Merge with the following range, then with the preceding one
+    if (next + 1 != freeList.end() && next->offset + next->size == (next + 1)->offset)
+    {
+        next->size += (next + 1)->size;
+        freeList.erase(next + 1);
+    }
+    if (next != freeList.begin() && (next - 1)->offset + (next - 1)->size == next->offset)
+    {
+        (next - 1)->size += next->size;
+        freeList.erase(next);
+    }
+}
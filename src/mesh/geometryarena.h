@@ -0,0 +1,71 @@
+#pragma once
+#include <glad/glad.h>
+#include <cstddef>
+#include <vector>
+
+// Where a mesh's data lives inside the GeometryArena. Indices are relative to
+// the mesh's first vertex, so draws pass baseVertex along with indexOffset.
+struct GeometryAllocation {
+    static const GLuint NO_PAGE = ~0u;
+
+    GLuint page = NO_PAGE;
+    GLint baseVertex = 0;
+    GLsizei vertexCount = 0;
+    // In bytes, into the page's index buffer
+    size_t indexOffset = 0;
+    size_t indexBytes = 0;
+
+    bool isValid() const { return page != NO_PAGE; }
+};
+
+// Suballocates every mesh's PackedVertex and index data from a few large
+// buffers. Each page is one VBO + EBO pair with a single VAO describing the
+// packed vertex format, so consecutive draws from the same page need no VAO
+// switch at all. Meshes bigger than a page get a page of their own.
+//
+// Binds go through GLState, so switching to the page that is already bound
+// costs nothing. Context thread only.
+class GeometryArena
+{
+public:
+    static const size_t PAGE_VERTICES = 1 << 18;
+    static const size_t PAGE_INDEX_BYTES = 4 << 20;
+private:
+    struct Range {
+        size_t offset, size;
+    };
+    struct Page {
+        GLuint VAO = 0, VBO = 0, EBO = 0;
+        size_t vertexCapacity = 0, indexCapacity = 0;
+        size_t allocations = 0;
+        // Sorted by offset and coalesced
+        std::vector<Range> freeVertices, freeIndices;
+    };
+
+    std::vector<Page> m_Pages;
+    size_t m_BindCount = 0;
+    size_t m_UsedBytes = 0;
+public:
+    static GeometryArena& Get();
+
+    GeometryAllocation Allocate(const void* vertices, GLsizei vertexCount, const void* indices, size_t indexBytes);
+    // Returns the ranges; a page is deleted once nothing is left in it
+    void Free(GeometryAllocation& allocation);
+
+    void Bind(GLuint page);
+    void Unbind();
+
+    size_t GetPageCount() const;
+    inline size_t GetUsedBytes() const { return m_UsedBytes; }
+    // VAO switches since the last ResetBindCount, for reporting
+    inline size_t GetBindCount() const { return m_BindCount; }
+    inline void ResetBindCount() { m_BindCount = 0; }
+private:
+    GeometryArena() {}
+    GeometryArena(const GeometryArena&) = delete;
+    GeometryArena& operator=(const GeometryArena&) = delete;
+
+    GLuint createPage(size_t vertexCapacity, size_t indexCapacity);
+    static bool take(std::vector<Range>& freeList, size_t size, size_t alignment, size_t& offset);
+    static void give(std::vector<Range>& freeList, size_t offset, size_t size);
+};
@@ -1,34 +1,92 @@
 #include "mesh.h"
 
-Mesh::Mesh(std::vector<Vertex> vertices, std::vector<GLuint> indices, std::vector<Texture> textures)
-    : vertices(vertices), indices(indices), textures(textures)
+#include <glm/gtc/packing.hpp>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+#include <utility>
+#include "../utils/glstate.h"
+
+static float signNotZero(float v)
 {
-    setupMesh();
+    return v < 0.0f ? -1.0f : 1.0f;
 }
 
-void Mesh::initDraw(Shader& shader) const
+// Folds the unit sphere onto the [-1, 1] square: the upper hemisphere maps to
+// the inner diamond and the lower one is mirrored into the corners.
+static glm::vec2 octahedralEncode(glm::vec3 n)
+{
+    float l1 = std::abs(n.x) + std::abs(n.y) + std::abs(n.z);
+    if (l1 == 0.0f)
+        return glm::vec2(0.0f);
+    n /= l1;
+    if (n.z < 0.0f)
+        return glm::vec2((1.0f - std::abs(n.y)) * signNotZero(n.x), (1.0f - std::abs(n.x)) * signNotZero(n.y));
+    return glm::vec2(n.x, n.y);
+}
+
+Mesh::Mesh(const PackedVertex* packed, GLsizei vertexCount, const void* indexData, GLsizei indexCount, GLenum indexType,
+    glm::vec3 positionScale, glm::vec3 positionBias, std::vector<Texture> textures)
+    : textures(std::move(textures)), vertexCount(vertexCount), indexCount(indexCount),
+    positionScale(positionScale), positionBias(positionBias)
+{
+    assignTextureUnits();
+    upload(packed, indexData, indexType);
+}
+
+Mesh::Mesh(const PackedGeometry& geometry, std::vector<Texture> textures)
+    : Mesh(geometry.vertices.data(), (GLsizei)geometry.vertices.size(), geometry.indices.data(), geometry.indexCount, geometry.indexType,
+        geometry.positionScale, geometry.positionBias, std::move(textures))
+{
+}
+
+Mesh::Mesh(Mesh&& other) noexcept
+    : vertices(std::move(other.vertices)), indices(std::move(other.indices)), textures(std::move(other.textures)),
+    bounds(other.bounds), allocation(other.allocation),
+    vertexCount(other.vertexCount), indexCount(other.indexCount), indexType(other.indexType),
+    positionScale(other.positionScale), positionBias(other.positionBias), releasedBytes(other.releasedBytes)
+{
+    other.allocation = GeometryAllocation();
+}
+
+Mesh& Mesh::operator=(Mesh&& other) noexcept
+{
+    if (this != &other)
+    {
+        releaseBuffers();
+        vertices = std::move(other.vertices);
+        indices = std::move(other.indices);
+        textures = std::move(other.textures);
+        bounds = other.bounds;
+        allocation = other.allocation;
+        vertexCount = other.vertexCount;
+        indexCount = other.indexCount;
+        indexType = other.indexType;
+        positionScale = other.positionScale;
+        positionBias = other.positionBias;
+        releasedBytes = other.releasedBytes;
+        other.allocation = GeometryAllocation();
+    }
+    return *this;
+}
+
+Mesh::~Mesh()
 {
-    GLuint diffuseNr = 1;
-    GLuint specularNr = 1;
-    GLuint normalNr = 1;
-    GLuint heightNr = 1;
+    releaseBuffers();
+}
 
-    for (unsigned int i = 0; i < textures.size(); i++)
+void Mesh::initDraw(Shader& shader) const
+{
+    // The samplers point at fixed units (see MaterialUnit), so drawing a mesh
+    // is only binds, most of which the state cache drops
+    for (const auto& texture : textures)
     {
-        glActiveTexture(GL_TEXTURE0 + i);
-
-        std::string name = textures[i].type;
-        if (name == "texture_diffuse")
-            name += std::to_string(diffuseNr++);
-        else if (name == "texture_specular")
-            name += std::to_string(specularNr++);
-        else if (name == "texture_normal")
-            name += std::to_string(normalNr++);
-        else if (name == "texture_height")
-            name += std::to_string(heightNr++);
-        shader.setInt(("material." + name).c_str(), i);
-        glBindTexture(GL_TEXTURE_2D, textures[i].id);
+        if (texture.unit >= 0)
+            GLState::BindTexture(texture.unit, GL_TEXTURE_2D, texture.id);
     }
+    shader.setVec3("positionScale", positionScale);
+    shader.setVec3("positionBias", positionBias);
+    GeometryArena::Get().Bind(allocation.page);
 }
 
 void Mesh::draw(Shader& shader) const
@@ -36,46 +94,126 @@ void Mesh::draw(Shader& shader) const
     initDraw(shader);
 
     // draw mesh
-    glBindVertexArray(VAO);
-    glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
-    glBindVertexArray(0);
-
-    glActiveTexture(GL_TEXTURE0);
+    glDrawElementsBaseVertex(GL_TRIANGLES, indexCount, indexType, GetIndexOffset(), allocation.baseVertex);
+    GeometryArena::Get().Unbind();
 }
 
-void Mesh::setupMesh()
+void Mesh::bindInstances(GLuint buffer, GLintptr offset) const
 {
-    glGenVertexArrays(1, &VAO);
-    glGenBuffers(1, &VBO);
-    glGenBuffers(1, &EBO);
+    GeometryArena::Get().Bind(allocation.page);
+    GLState::BindBuffer(GL_ARRAY_BUFFER, buffer);
 
-    glBindVertexArray(VAO);
-    glBindBuffer(GL_ARRAY_BUFFER, VBO);
+    // model matrix, one column per attribute
+    for (GLuint i = 0; i < 4; i++)
+    {
+        glEnableVertexAttribArray(5 + i);
+        glVertexAttribPointer(5 + i, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceData), (void*)(offset + offsetof(InstanceData, Model) + i * sizeof(glm::vec4)));
+        glVertexAttribDivisor(5 + i, 1);
+    }
 
-    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), &vertices[0], GL_STATIC_DRAW);
+    // color
+    glEnableVertexAttribArray(9);
+    glVertexAttribPointer(9, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceData), (void*)(offset + offsetof(InstanceData, Color)));
+    glVertexAttribDivisor(9, 1);
 
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLuint), &indices[0], GL_STATIC_DRAW);
+    // normal matrix, precomputed by the SceneGraph
+    for (GLuint i = 0; i < 3; i++)
+    {
+        glEnableVertexAttribArray(10 + i);
+        glVertexAttribPointer(10 + i, 3, GL_FLOAT, GL_FALSE, sizeof(InstanceData), (void*)(offset + offsetof(InstanceData, Normal) + i * sizeof(glm::vec3)));
+        glVertexAttribDivisor(10 + i, 1);
+    }
 
-    // vertex positions;
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FLOAT, sizeof(Vertex), 0);
+    GLState::BindBuffer(GL_ARRAY_BUFFER, 0);
+}
 
-    // normals
-    glEnableVertexAttribArray(1);
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FLOAT, sizeof(Vertex), (void*)offsetof(Vertex, Normal));
+void Mesh::releaseBuffers()
+{
+    // Moved-from meshes hold no range, which Free ignores
+    GeometryArena::Get().Free(allocation);
+}
 
-    // texcoords
-    glEnableVertexAttribArray(2);
-    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FLOAT, sizeof(Vertex), (void*)offsetof(Vertex, TexCoords));
+GLint Mesh::GetMaterialUnit(const std::string& type)
+{
+    if (type == "texture_diffuse")
+        return (GLint)MaterialUnit::Diffuse;
+    if (type == "texture_normal")
+        return (GLint)MaterialUnit::Normal;
+    if (type == "texture_specular")
+        return (GLint)MaterialUnit::Specular;
+    if (type == "texture_height")
+        return (GLint)MaterialUnit::Height;
+    return -1;
+}
 
-    // tangent
-    glEnableVertexAttribArray(3);
-    glVertexAttribPointer(3, 3, GL_FLOAT, GL_FLOAT, sizeof(Vertex), (void*)offsetof(Vertex, Tangent));
+void Mesh::Pack(const std::vector<Vertex>& vertices, const std::vector<GLuint>& indices, PackedGeometry& geometry)
+{
+    // Quantize positions to 16 bits across the mesh's box
+    glm::vec3 boxMin(FLT_MAX), boxMax(-FLT_MAX);
+    for (const auto& v : vertices)
+    {
+        boxMin = glm::min(boxMin, v.Position);
+        boxMax = glm::max(boxMax, v.Position);
+    }
+    if (vertices.empty())
+        boxMin = boxMax = glm::vec3(0.0f);
+    glm::vec3 extent = boxMax - boxMin;
+    geometry.positionScale = extent;
+    geometry.positionBias = boxMin;
+    glm::vec3 invExtent;
+    for (int i = 0; i < 3; i++)
+        invExtent[i] = extent[i] > 0.0f ? 1.0f / extent[i] : 0.0f;
+
+    geometry.vertices.resize(vertices.size());
+    for (size_t i = 0; i < vertices.size(); i++)
+    {
+        const Vertex& v = vertices[i];
+        PackedVertex& p = geometry.vertices[i];
+        glm::vec3 position = (v.Position - boxMin) * invExtent;
+        p.Position[0] = glm::packUnorm1x16(position.x);
+        p.Position[1] = glm::packUnorm1x16(position.y);
+        p.Position[2] = glm::packUnorm1x16(position.z);
+        p.Position[3] = 0;
+
+        float bitangentSign = signNotZero(glm::dot(glm::cross(v.Normal, v.Tangent), v.Bitangent));
+        p.Normal = glm::packSnorm3x10_1x2(glm::vec4(octahedralEncode(v.Normal), 0.0f, 0.0f));
+        p.Tangent = glm::packSnorm3x10_1x2(glm::vec4(octahedralEncode(v.Tangent), 0.0f, bitangentSign));
+        p.TexCoords = glm::packHalf2x16(v.TexCoords);
+    }
 
-    // bitangent
-    glEnableVertexAttribArray(4);
-    glVertexAttribPointer(4, 3, GL_FLOAT, GL_FLOAT, sizeof(Vertex), (void*)offsetof(Vertex, Bitangent));
+    geometry.indexCount = (GLsizei)indices.size();
+    if (vertices.size() <= 65536)
+    {
+        geometry.indexType = GL_UNSIGNED_SHORT;
+        geometry.indices.resize(indices.size() * sizeof(GLushort));
+        GLushort* shortIndices = (GLushort*)geometry.indices.data();
+        for (size_t i = 0; i < indices.size(); i++)
+            shortIndices[i] = (GLushort)indices[i];
+    }
+    else
+    {
+        geometry.indexType = GL_UNSIGNED_INT;
+        geometry.indices.resize(indices.size() * sizeof(GLuint));
+        std::memcpy(geometry.indices.data(), indices.data(), geometry.indices.size());
+    }
+}
 
-    glBindVertexArray(0);
+void Mesh::assignTextureUnits()
+{
+    // Only texture_<type>1 has a sampler, so later ones of a type stay unbound
+    bool used[4] = {};
+    for (auto& texture : textures)
+    {
+        texture.unit = GetMaterialUnit(texture.type);
+        if (texture.unit >= 0 && used[texture.unit])
+            texture.unit = -1;
+        else if (texture.unit >= 0)
+            used[texture.unit] = true;
+    }
+}
+
+void Mesh::upload(const PackedVertex* packed, const void* indexData, GLenum type)
+{
+    indexType = type;
+    allocation = GeometryArena::Get().Allocate(packed, vertexCount, indexData, (size_t)indexCount * GetIndexSize());
 }
@@ -1,23 +1,107 @@
 #pragma once
 #include <glm/glm.hpp>
 #include <glad/glad.h>
-#include <gl/GL.h>
+#include <cfloat>
+#include <memory>
 #include <string>
 #include <vector>
 #include "../shaders/shader.h"
+#include "geometryarena.h"
 
 struct Vertex {
     glm::vec3 Position;
     glm::vec3 Normal;
-    glm::vec3 TexCoords;
+    glm::vec2 TexCoords;
     glm::vec3 Tangent;
     glm::vec3 Bitangent;
 };
 
+// What actually goes to the GPU, 20 bytes instead of 60:
+//   Position  unorm16 inside the mesh's box, decoded with positionScale/Bias
+//   Normal    octahedral xy as snorm 10:10 (GL_INT_2_10_10_10_REV)
+//   Tangent   octahedral xy as snorm 10:10, w holds the bitangent sign
+//   TexCoords half floats
+// See src/shaders/VertexFormat.glsl for the decode.
+struct PackedVertex {
+    GLushort Position[4];
+    GLuint Normal;
+    GLuint Tangent;
+    GLuint TexCoords;
+};
+
+// Per-instance vertex attributes: the model matrix takes locations 5-8
+// (one per column), the color location 9 and the normal matrix 10-12.
+struct InstanceData {
+    glm::mat4 Model;
+    glm::vec4 Color;
+    glm::mat3 Normal;
+};
+
+struct TextureResource;
+
+// Texture units of the material samplers in GBuffer.frag. The sampler
+// uniforms are set once at startup and every mesh binds into these.
+enum class MaterialUnit : GLint {
+    Diffuse = 0,
+    Normal = 1,
+    Specular = 2,
+    Height = 3
+};
+
 struct Texture {
     GLuint id;
     std::string type;
     std::string path;
+    // Keeps id resident in the TextureCache; empty until the texture is loaded
+    std::shared_ptr<const TextureResource> resource;
+    // MaterialUnit this is bound to, -1 when the shader has no sampler for it
+    GLint unit = -1;
+};
+
+// Object-space bounds; the sphere is centred on the box and only as large as
+// the farthest vertex, which is usually tighter than the box's half-diagonal.
+struct Bounds {
+    glm::vec3 min = glm::vec3(FLT_MAX);
+    glm::vec3 max = glm::vec3(-FLT_MAX);
+    glm::vec3 center = glm::vec3(0.0f);
+    float radius = 0.0f;
+
+    bool isValid() const { return min.x <= max.x; }
+    void extend(const glm::vec3& p)
+    {
+        min = glm::min(min, p);
+        max = glm::max(max, p);
+    }
+};
+
+enum class MeshResidency {
+    // vertices/indices are released as soon as they are on the GPU
+    GpuOnly,
+    // keep the CPU copies readable, e.g. for collision or picking
+    KeepCpu
+};
+
+// Vertex and index data in GPU layout, built without touching GL so it can
+// be prepared on a worker thread and uploaded later
+struct PackedGeometry {
+    std::vector<PackedVertex> vertices;
+    // GLushort or GLuint indices depending on indexType
+    std::vector<unsigned char> indices;
+    GLsizei indexCount = 0;
+    GLenum indexType = GL_UNSIGNED_INT;
+    glm::vec3 positionScale = glm::vec3(1.0f);
+    glm::vec3 positionBias = glm::vec3(0.0f);
+};
+
+// Everything needed to create a Mesh on the GL thread
+struct MeshSource {
+    PackedGeometry geometry;
+    Bounds bounds;
+    // Only type and path are set until the texture is loaded
+    std::vector<Texture> textures;
+    // Filled for MeshResidency::KeepCpu only
+    std::vector<Vertex> vertices;
+    std::vector<GLuint> indices;
 };
 
 class Mesh {
@@ -25,11 +109,48 @@ public:
     std::vector<Vertex> vertices;
     std::vector<GLuint> indices;
     std::vector<Texture> textures;
-    GLuint VAO, VBO, EBO;
+    Bounds bounds;
+    // Vertex and index range inside the shared GeometryArena
+    GeometryAllocation allocation;
+    // Counts stay valid after the CPU copies are released
+    GLsizei vertexCount, indexCount;
+    // GL_UNSIGNED_SHORT whenever every index fits, GL_UNSIGNED_INT otherwise
+    GLenum indexType = GL_UNSIGNED_INT;
+    // Maps the quantized positions back to object space
+    glm::vec3 positionScale = glm::vec3(1.0f);
+    glm::vec3 positionBias = glm::vec3(0.0f);
+    // Host memory given back after upload, 0 when the CPU copies are kept
+    size_t releasedBytes = 0;
 
-    Mesh(std::vector<Vertex> vertices, std::vector<GLuint> indices, std::vector<Texture> textures);
+    // Uploads geometry that is already packed, e.g. mapped from the mesh cache.
+    // No CPU copies exist afterwards, whatever the residency.
+    Mesh(const PackedVertex* packed, GLsizei vertexCount, const void* indexData, GLsizei indexCount, GLenum indexType,
+        glm::vec3 positionScale, glm::vec3 positionBias, std::vector<Texture> textures);
+    Mesh(const PackedGeometry& geometry, std::vector<Texture> textures);
+    // Owns its arena range, so it can be moved but not copied
+    Mesh(const Mesh&) = delete;
+    Mesh& operator=(const Mesh&) = delete;
+    Mesh(Mesh&& other) noexcept;
+    Mesh& operator=(Mesh&& other) noexcept;
+    ~Mesh();
+    // Binds the textures, the position decode and the arena page's VAO
     void initDraw(Shader& shader) const;
     void draw(Shader& shader) const;
+    // Points the instance attributes of the mesh's arena page at InstanceData
+    // records starting at offset in buffer; meshes on the same page share them
+    void bindInstances(GLuint buffer, GLintptr offset) const;
+
+    // Converts to the GPU layout; touches no GL state, so any thread may call it
+    static void Pack(const std::vector<Vertex>& vertices, const std::vector<GLuint>& indices, PackedGeometry& geometry);
+
+    // Unit for the first texture of each type, -1 for the rest
+    static GLint GetMaterialUnit(const std::string& type);
+
+    inline GLsizei GetIndexSize() const { return indexType == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint); }
+    // Byte offset of the first index, for the glDraw*BaseVertex calls
+    inline const void* GetIndexOffset() const { return (const void*)allocation.indexOffset; }
 private:
-    void setupMesh();
+    void assignTextureUnits();
+    void upload(const PackedVertex* packed, const void* indexData, GLenum type);
+    void releaseBuffers();
 };
\ No newline at end of file
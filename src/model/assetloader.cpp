@@ -0,0 +1,162 @@
+#include "assetloader.h"
+#include "meshcache.h"
+
+#include <chrono>
+#include <iostream>
+#include <limits>
+#include "../utils/stb_image.h"
+#include "../utils/fileutils.h"
+
+AssetLoader::AssetLoader(unsigned threadCount)
+    : m_ThreadPool(threadCount)
+{
+}
+
+AssetLoader::~AssetLoader()
+{
+    // Queued work is drained when the pool is joined; skip what hasn't started
+    m_Stopping = true;
+}
+
+std::shared_ptr<Model> AssetLoader::LoadModel(const std::string& path, MeshResidency residency, std::shared_ptr<const Model> placeholder)
+{
+#ifdef _DEBUG
+    std::cout << "Streaming model at " + path << std::endl;
+#endif
+    auto model = std::make_shared<Model>(path.c_str(), residency, this, std::move(placeholder));
+    m_Pending++;
+    m_ThreadPool.Enqueue([this, model, path]() {
+        if (m_Stopping)
+            return;
+
+        // The cache only holds packed GPU data, so it can't serve KeepCpu models
+        std::shared_ptr<MappedFile> cache;
+        if (model->GetResidency() == MeshResidency::GpuOnly)
+            cache = MeshCache::Open(path, Model::IMPORT_FLAGS);
+        if (cache)
+        {
+            cache->touch();
+            for (uint32_t i = 0; i < MeshCache::GetMeshCount(*cache); i++)
+                queueUpload([model, cache, i]() { MeshCache::LoadMesh(*cache, i, *model); });
+        }
+        else
+        {
+            auto sources = std::make_shared<std::vector<MeshSource>>();
+            if (model->readSources(path, *sources, &m_ThreadPool))
+            {
+                MeshCache::Write(path, Model::IMPORT_FLAGS, *sources);
+                for (size_t i = 0; i < sources->size(); i++)
+                    queueUpload([model, sources, i]() { model->addMesh((*sources)[i]); });
+            }
+        }
+
+        // Uploads run in queue order, so every mesh is in before this
+        queueUpload([this, model, path]() {
+            model->finishLoading();
+            m_Pending--;
+#ifdef _DEBUG
+            std::cout << "Model streamed in: " << path << std::endl;
+#endif
+        });
+    });
+    return model;
+}
+
+GLuint AssetLoader::LoadTexture(const std::string& path, TextureRole role, bool gamma, const glm::vec4& placeholder,
+    std::function<void(size_t)> uploaded)
+{
+    GLuint textureID;
+    glGenTextures(1, &textureID);
+    GLubyte texel[4];
+    for (int i = 0; i < 4; i++)
+        texel[i] = (GLubyte)(glm::clamp(placeholder[i], 0.0f, 1.0f) * 255.0f + 0.5f);
+    GLState::BindTexture(GL_TEXTURE_2D, textureID);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, texel);
+    // No mip chain yet, so a mipmapped filter would leave it incomplete
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    GLState::BindTexture(GL_TEXTURE_2D, 0);
+
+    m_Pending++;
+    // uploaded is moved along rather than copied so whatever it holds is only
+    // ever released on the context thread
+    m_ThreadPool.Enqueue([this, path, role, gamma, textureID, uploaded]() mutable {
+        if (m_Stopping)
+        {
+            queueUpload([uploaded = std::move(uploaded)]() {});
+            return;
+        }
+
+        auto compressed = std::make_shared<CompressedTexture>();
+        if (CompressedTexture::Load(path, role, gamma, *compressed))
+        {
+            queueUpload([this, compressed, textureID, uploaded = std::move(uploaded)]() {
+                size_t bytes = compressed->Upload(textureID);
+                if (uploaded)
+                    uploaded(bytes);
+                m_Pending--;
+            });
+            return;
+        }
+
+        int width, height, nrChannels;
+        // Owned by the upload, so it is freed even if that never gets to run
+        std::shared_ptr<unsigned char> data(stbi_load(path.c_str(), &width, &height, &nrChannels, 0), stbi_image_free);
+        queueUpload([this, path, gamma, textureID, data, width, height, nrChannels, uploaded = std::move(uploaded)]() {
+            size_t bytes = 0;
+            if (data)
+                bytes = UploadTexture(textureID, data.get(), width, height, nrChannels, gamma);
+            else
+                std::cout << "Failed to load texture: " << path << std::endl;
+            if (uploaded)
+                uploaded(bytes);
+            m_Pending--;
+        });
+    });
+    return textureID;
+}
+
+bool AssetLoader::Update(double budgetMs)
+{
+    auto start = std::chrono::steady_clock::now();
+    while (true)
+    {
+        std::function<void()> upload;
+        {
+            std::lock_guard<std::mutex> lock(m_Mutex);
+            if (m_Uploads.empty())
+                break;
+            upload = std::move(m_Uploads.front());
+            m_Uploads.pop_front();
+        }
+        upload();
+
+        std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+        if (elapsed.count() >= budgetMs)
+            break;
+    }
+    return m_Pending > 0;
+}
+
+void AssetLoader::Finish()
+{
+    // Only uploads run here decrement m_Pending, so while it is non-zero a
+    // worker is guaranteed to queue at least one more
+    while (m_Pending > 0)
+    {
+        {
+            std::unique_lock<std::mutex> lock(m_Mutex);
+            m_Queued.wait(lock, [this]() { return !m_Uploads.empty(); });
+        }
+        Update(std::numeric_limits<double>::max());
+    }
+}
+
+void AssetLoader::queueUpload(std::function<void()> upload)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        m_Uploads.push_back(std::move(upload));
+    }
+    m_Queued.notify_one();
+}
@@ -0,0 +1,59 @@
+#pragma once
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include "model.h"
+#include "../textures/compressedtexture.h"
+#include "../utils/threadpool.h"
+
+// Streams models and textures in without blocking the render thread.
+//
+// Workers do everything that doesn't need GL: mapping mesh caches, Assimp
+// imports, packing meshes (in parallel per model) and decoding images. Each
+// finished step queues a small upload that Update() runs on the context
+// thread, as many as fit in the frame's budget. Images are block-compressed
+// (or read from their compressed cache) on the workers too.
+//
+// Handles are returned straight away. A model draws its placeholder until its
+// last mesh is uploaded; a texture is a 1x1 texel of the given colour until
+// its image arrives, then the same texture object is filled in.
+class AssetLoader
+{
+private:
+    std::mutex m_Mutex;
+    std::condition_variable m_Queued;
+    std::deque<std::function<void()>> m_Uploads;
+    // Models and textures that have not been fully uploaded yet
+    std::atomic<size_t> m_Pending{ 0 };
+    std::atomic<bool> m_Stopping{ false };
+    // Declared last so its workers are joined before anything they touch goes away
+    ThreadPool m_ThreadPool;
+public:
+    AssetLoader(unsigned threadCount = 0);
+    ~AssetLoader();
+
+    std::shared_ptr<Model> LoadModel(const std::string& path, MeshResidency residency, std::shared_ptr<const Model> placeholder);
+    // Context thread only, since the texture object is created immediately.
+    // The image is block-compressed on the worker when possible. uploaded is
+    // called on the context thread with the GPU size once the image is in.
+    GLuint LoadTexture(const std::string& path, TextureRole role, bool gamma, const glm::vec4& placeholder,
+        std::function<void(size_t)> uploaded = nullptr);
+
+    // Runs queued uploads until budgetMs has passed (at least one if any are
+    // waiting). Returns true while anything is still loading.
+    bool Update(double budgetMs);
+    // Blocks until every requested asset is uploaded
+    void Finish();
+
+    inline bool IsIdle() const { return m_Pending == 0; }
+    inline size_t GetPendingCount() const { return m_Pending; }
+private:
+    void queueUpload(std::function<void()> upload);
+};
@@ -0,0 +1,349 @@
+#include "meshcache.h"
+#include "model.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <thread>
+
+namespace
+{
+    struct CacheHeader
+    {
+        char magic[8];
+        uint32_t version;
+        uint32_t vertexStride;
+        uint32_t importFlags;
+        uint32_t meshCount;
+        int64_t sourceTime;
+        uint64_t sourceSize;
+        uint64_t dependencyOffset;
+        uint32_t dependencyCount;
+        uint32_t reserved;
+    };
+
+    struct CacheMesh
+    {
+        uint64_t vertexOffset;
+        uint64_t indexOffset;
+        uint64_t textureOffset;
+        uint32_t vertexCount;
+        uint32_t indexCount;
+        uint32_t indexType;
+        uint32_t textureCount;
+        float positionScale[3];
+        float positionBias[3];
+        float boundsMin[3];
+        float boundsMax[3];
+        float boundsCenter[3];
+        float boundsRadius;
+    };
+
+    struct CacheDependency
+    {
+        int64_t time;
+        uint64_t size;
+        uint32_t pathLength;
+        uint32_t reserved;
+    };
+
+    const char MAGIC[8] = { 'L', 'O', 'G', 'L', 'M', 'E', 'S', 'H' };
+    // Stamp of a dependency that didn't exist, so the cache goes stale if it appears
+    const uint64_t MISSING_SIZE = ~(uint64_t)0;
+
+    bool stampFile(const std::string& path, int64_t& time, uint64_t& size)
+    {
+        std::error_code error;
+        auto writeTime = std::filesystem::last_write_time(path, error);
+        if (error)
+            return false;
+        auto fileSize = std::filesystem::file_size(path, error);
+        if (error)
+            return false;
+        time = (int64_t)writeTime.time_since_epoch().count();
+        size = (uint64_t)fileSize;
+        return true;
+    }
+
+    bool stampSource(const std::string& path, CacheHeader& header)
+    {
+        return stampFile(path, header.sourceTime, header.sourceSize);
+    }
+
+    void stampDependency(const std::string& path, CacheDependency& dependency)
+    {
+        if (!stampFile(path, dependency.time, dependency.size))
+        {
+            dependency.time = 0;
+            dependency.size = MISSING_SIZE;
+        }
+    }
+
+    // Dependencies are stored relative to the source's directory, the same
+    // way Model resolves them, so a moved asset folder keeps its cache
+    std::string resolveDependency(const std::string& sourcePath, const std::string& name)
+    {
+        return sourcePath.substr(0, sourcePath.find_last_of('/')) + '/' + name;
+    }
+
+    // Everything besides the source the import read or points at: an .obj's
+    // mtllib files and every texture the materials name
+    std::vector<std::string> listDependencies(const std::string& sourcePath, const std::vector<MeshSource>& sources)
+    {
+        std::vector<std::string> names;
+        std::string extension = std::filesystem::path(sourcePath).extension().string();
+        std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) { return (char)std::tolower(c); });
+        if (extension == ".obj")
+        {
+            std::ifstream in(sourcePath);
+            std::string line;
+            while (std::getline(in, line))
+            {
+                size_t begin = line.find_first_not_of(" \t");
+                if (begin == std::string::npos || line.compare(begin, 7, "mtllib ") != 0)
+                    continue;
+                begin = line.find_first_not_of(" \t", begin + 7);
+                size_t end = line.find_last_not_of(" \t\r");
+                if (begin != std::string::npos && end >= begin)
+                    names.push_back(line.substr(begin, end - begin + 1));
+            }
+        }
+        for (const auto& source : sources)
+        {
+            for (const auto& t : source.textures)
+                names.push_back(t.path);
+        }
+        std::sort(names.begin(), names.end());
+        names.erase(std::unique(names.begin(), names.end()), names.end());
+        return names;
+    }
+
+    uint64_t align(uint64_t offset)
+    {
+        return (offset + 15) & ~(uint64_t)15;
+    }
+}
+
+std::string MeshCache::GetPath(const std::string& sourcePath)
+{
+    return sourcePath + ".meshcache";
+}
+
+std::shared_ptr<MappedFile> MeshCache::Open(const std::string& sourcePath, unsigned importFlags)
+{
+    CacheHeader expected;
+    if (!stampSource(sourcePath, expected))
+        return NULL;
+
+    auto file = std::make_shared<MappedFile>(GetPath(sourcePath));
+    if (!file->isValid() || file->getSize() < sizeof(CacheHeader))
+        return NULL;
+    const unsigned char* data = file->getData();
+    const CacheHeader* header = (const CacheHeader*)data;
+    if (std::memcmp(header->magic, MAGIC, sizeof(MAGIC)) != 0 || header->version != VERSION
+        || header->vertexStride != sizeof(PackedVertex) || header->importFlags != importFlags
+        || header->sourceTime != expected.sourceTime || header->sourceSize != expected.sourceSize)
+    {
+#ifdef _DEBUG
+        std::cout << "Mesh cache for " << sourcePath << " is stale" << std::endl;
+#endif
+        return NULL;
+    }
+    uint64_t size = file->getSize();
+    if (size < sizeof(CacheHeader) + (uint64_t)header->meshCount * sizeof(CacheMesh))
+        return NULL;
+
+    // Validate every range up front so LoadMesh can trust the records; a
+    // truncated or corrupt cache is a miss like a stale one
+    const CacheMesh* records = (const CacheMesh*)(data + sizeof(CacheHeader));
+    for (uint32_t i = 0; i < header->meshCount; i++)
+    {
+        const CacheMesh& r = records[i];
+        if (r.indexType != GL_UNSIGNED_SHORT && r.indexType != GL_UNSIGNED_INT)
+            return NULL;
+        uint64_t indexSize = r.indexType == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint);
+        if (r.vertexOffset > size || (uint64_t)r.vertexCount * sizeof(PackedVertex) > size - r.vertexOffset
+            || r.indexOffset > size || (uint64_t)r.indexCount * indexSize > size - r.indexOffset
+            || r.textureOffset > size)
+            return NULL;
+
+        uint64_t cursor = r.textureOffset;
+        for (uint32_t t = 0; t < r.textureCount; t++)
+        {
+            uint32_t lengths[2];
+            if (sizeof(lengths) > size - cursor)
+                return NULL;
+            std::memcpy(lengths, data + cursor, sizeof(lengths));
+            cursor += sizeof(lengths);
+            if ((uint64_t)lengths[0] + lengths[1] > size - cursor)
+                return NULL;
+            cursor += (uint64_t)lengths[0] + lengths[1];
+        }
+    }
+
+    uint64_t cursor = header->dependencyOffset;
+    if (cursor > size)
+        return NULL;
+    for (uint32_t i = 0; i < header->dependencyCount; i++)
+    {
+        CacheDependency stored;
+        if (sizeof(stored) > size - cursor)
+            return NULL;
+        std::memcpy(&stored, data + cursor, sizeof(stored));
+        cursor += sizeof(stored);
+        if (stored.pathLength > size - cursor)
+            return NULL;
+        std::string name((const char*)data + cursor, stored.pathLength);
+        cursor += stored.pathLength;
+
+        CacheDependency current;
+        stampDependency(resolveDependency(sourcePath, name), current);
+        if (current.time != stored.time || current.size != stored.size)
+        {
+#ifdef _DEBUG
+            std::cout << "Mesh cache for " << sourcePath << " is stale, " << name << " changed" << std::endl;
+#endif
+            return NULL;
+        }
+    }
+    return file;
+}
+
+uint32_t MeshCache::GetMeshCount(const MappedFile& cache)
+{
+    return ((const CacheHeader*)cache.getData())->meshCount;
+}
+
+void MeshCache::LoadMesh(const MappedFile& cache, uint32_t index, Model& model)
+{
+    const unsigned char* data = cache.getData();
+    const CacheMesh& r = ((const CacheMesh*)(data + sizeof(CacheHeader)))[index];
+
+    // Open has checked every record fits
+    std::vector<Texture> textures;
+    const unsigned char* cursor = data + r.textureOffset;
+    for (uint32_t t = 0; t < r.textureCount; t++)
+    {
+        uint32_t lengths[2];
+        std::memcpy(lengths, cursor, sizeof(lengths));
+        cursor += sizeof(lengths);
+        std::string type((const char*)cursor, lengths[0]);
+        std::string path((const char*)cursor + lengths[0], lengths[1]);
+        cursor += lengths[0] + lengths[1];
+        textures.push_back(model.loadTexture(path, type));
+    }
+
+    Mesh mesh((const PackedVertex*)(data + r.vertexOffset), (GLsizei)r.vertexCount,
+        data + r.indexOffset, (GLsizei)r.indexCount, (GLenum)r.indexType,
+        glm::vec3(r.positionScale[0], r.positionScale[1], r.positionScale[2]),
+        glm::vec3(r.positionBias[0], r.positionBias[1], r.positionBias[2]),
+        std::move(textures));
+    mesh.bounds.min = glm::vec3(r.boundsMin[0], r.boundsMin[1], r.boundsMin[2]);
+    mesh.bounds.max = glm::vec3(r.boundsMax[0], r.boundsMax[1], r.boundsMax[2]);
+    mesh.bounds.center = glm::vec3(r.boundsCenter[0], r.boundsCenter[1], r.boundsCenter[2]);
+    mesh.bounds.radius = r.boundsRadius;
+    model.meshes.push_back(std::move(mesh));
+}
+
+bool MeshCache::Write(const std::string& sourcePath, unsigned importFlags, const std::vector<MeshSource>& sources)
+{
+    CacheHeader header = {};
+    if (!stampSource(sourcePath, header))
+        return false;
+    std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = VERSION;
+    header.vertexStride = sizeof(PackedVertex);
+    header.importFlags = importFlags;
+    header.meshCount = (uint32_t)sources.size();
+
+    // Lay out the blobs first so the records can point at them
+    std::vector<CacheMesh> records(sources.size());
+    uint64_t offset = sizeof(CacheHeader) + records.size() * sizeof(CacheMesh);
+    for (size_t i = 0; i < sources.size(); i++)
+    {
+        const MeshSource& source = sources[i];
+        const PackedGeometry& geometry = source.geometry;
+        CacheMesh& r = records[i];
+        r = {};
+        r.vertexCount = (uint32_t)geometry.vertices.size();
+        r.indexCount = (uint32_t)geometry.indexCount;
+        r.indexType = (uint32_t)geometry.indexType;
+        r.textureCount = (uint32_t)source.textures.size();
+        for (int k = 0; k < 3; k++)
+        {
+            r.positionScale[k] = geometry.positionScale[k];
+            r.positionBias[k] = geometry.positionBias[k];
+            r.boundsMin[k] = source.bounds.min[k];
+            r.boundsMax[k] = source.bounds.max[k];
+            r.boundsCenter[k] = source.bounds.center[k];
+        }
+        r.boundsRadius = source.bounds.radius;
+
+        r.vertexOffset = offset = align(offset);
+        offset += geometry.vertices.size() * sizeof(PackedVertex);
+        r.indexOffset = offset = align(offset);
+        offset += geometry.indices.size();
+        r.textureOffset = offset;
+        for (const auto& t : source.textures)
+            offset += 2 * sizeof(uint32_t) + t.type.size() + t.path.size();
+    }
+    std::vector<std::string> dependencies = listDependencies(sourcePath, sources);
+    header.dependencyOffset = offset;
+    header.dependencyCount = (uint32_t)dependencies.size();
+
+    // Written to a temporary first so a reader never maps a half-written
+    // cache; the main thread and a loader thread may both write the same
+    // model, so each gets its own temporary
+    std::string tempPath = GetPath(sourcePath) + "." + std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id())) + ".tmp";
+    std::ofstream out(tempPath, std::ios::binary | std::ios::trunc);
+    if (!out)
+    {
+#ifdef _DEBUG
+        std::cout << "Could not write mesh cache " << GetPath(sourcePath) << std::endl;
+#endif
+        return false;
+    }
+    out.write((const char*)&header, sizeof(header));
+    out.write((const char*)records.data(), records.size() * sizeof(CacheMesh));
+
+    const char zeros[16] = {};
+    for (size_t i = 0; i < sources.size(); i++)
+    {
+        const MeshSource& source = sources[i];
+        const CacheMesh& r = records[i];
+
+        out.write(zeros, r.vertexOffset - (uint64_t)out.tellp());
+        out.write((const char*)source.geometry.vertices.data(), source.geometry.vertices.size() * sizeof(PackedVertex));
+        out.write(zeros, r.indexOffset - (uint64_t)out.tellp());
+        out.write((const char*)source.geometry.indices.data(), source.geometry.indices.size());
+
+        for (const auto& t : source.textures)
+        {
+            uint32_t lengths[2] = { (uint32_t)t.type.size(), (uint32_t)t.path.size() };
+            out.write((const char*)lengths, sizeof(lengths));
+            out.write(t.type.data(), t.type.size());
+            out.write(t.path.data(), t.path.size());
+        }
+    }
+    for (const auto& name : dependencies)
+    {
+        CacheDependency dependency = {};
+        stampDependency(resolveDependency(sourcePath, name), dependency);
+        dependency.pathLength = (uint32_t)name.size();
+        out.write((const char*)&dependency, sizeof(dependency));
+        out.write(name.data(), name.size());
+    }
+    out.close();
+    std::error_code error;
+    if (out.fail())
+    {
+        std::filesystem::remove(tempPath, error);
+        return false;
+    }
+    std::filesystem::rename(tempPath, GetPath(sourcePath), error);
+    return !error;
+}
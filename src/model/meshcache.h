@@ -0,0 +1,43 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "../mesh/mesh.h"
+#include "../utils/mappedfile.h"
+
+class Model;
+
+// Binary copy of a model's packed GPU geometry, written next to the source
+// asset as <path>.meshcache after the first import. Warm loads map the file
+// and hand the vertex/index blobs straight to glBufferData, skipping Assimp.
+//
+// Layout (native endianness, blobs 16-byte aligned):
+//   CacheHeader
+//   CacheMesh[meshCount]
+//   per mesh: PackedVertex[vertexCount], indices[indexCount] (16 or 32 bit),
+//             textureCount x { uint32 typeLength, uint32 pathLength, type, path }
+//   dependencyCount x { int64 time, uint64 size, uint32 pathLength, uint32 0, path }
+//
+// A cache is rejected when its version, vertex layout, importer flags or the
+// size and modification time of the source or one of its dependencies (the
+// .obj's material libraries and the textures they name) differ, or when any
+// record runs past the end of the file.
+class MeshCache
+{
+public:
+    // 2: node transforms are baked into the vertices
+    // 3: material libraries and textures are stamped too
+    static const uint32_t VERSION = 3;
+
+    static std::string GetPath(const std::string& sourcePath);
+    // Maps and validates the cache, NULL on a miss. No GL calls, so this can
+    // run on a loader thread.
+    static std::shared_ptr<MappedFile> Open(const std::string& sourcePath, unsigned importFlags);
+    static uint32_t GetMeshCount(const MappedFile& cache);
+    // Uploads one mesh straight from the mapping and appends it to the model
+    static void LoadMesh(const MappedFile& cache, uint32_t index, Model& model);
+    // Writes the packed geometry of a fresh import; no GL calls either
+    static bool Write(const std::string& sourcePath, unsigned importFlags, const std::vector<MeshSource>& sources);
+};
@@ -1,7 +1,14 @@
 #include "model.h"
+#include "meshcache.h"
+#include "assetloader.h"
 #include <iostream>
+#include <cstring>
+#include <algorithm>
+#include <cmath>
+#include <utility>
 #include "../utils/stb_image.h"
 #include "../utils/fileutils.h"
+#include "../textures/texturecache.h"
 #if _DEBUG
 #include "../window/window.h"
 #endif
@@ -9,146 +16,328 @@
 void Model::Draw(Shader& shader) const
 {
     for (GLuint i = 0; i < meshes.size(); i++)
-        meshes[i].draw(shader);
+    {
+        meshes[i].initDraw(shader);
+        glDrawElementsBaseVertex(GL_TRIANGLES, meshes[i].indexCount, meshes[i].indexType,
+            meshes[i].GetIndexOffset(), meshes[i].allocation.baseVertex);
+    }
+    GeometryArena::Get().Unbind();
 }
 
-void Model::InstancedDraw(Shader& shader, int amount)
+void Model::InstancedDraw(Shader& shader, GLsizei amount, GLuint instanceBuffer, GLintptr offset) const
 {
+    // The instance attributes live in the page's VAO, so they only need
+    // pointing at this batch when a mesh is on a different page than the last
+    GLuint page = GeometryAllocation::NO_PAGE;
     for (GLuint i = 0; i < meshes.size(); i++)
     {
         meshes[i].initDraw(shader);
-        glBindVertexArray(meshes[i].VAO);
-        glDrawElementsInstanced(
-            GL_TRIANGLES, meshes[i].indices.size(), GL_UNSIGNED_INT, 0, amount
+        if (meshes[i].allocation.page != page)
+        {
+            meshes[i].bindInstances(instanceBuffer, offset);
+            page = meshes[i].allocation.page;
+        }
+        glDrawElementsInstancedBaseVertex(
+            GL_TRIANGLES, meshes[i].indexCount, meshes[i].indexType, meshes[i].GetIndexOffset(), amount, meshes[i].allocation.baseVertex
         );
     }
 }
 
+size_t Model::GetReleasedBytes() const
+{
+    size_t bytes = 0;
+    for (const auto& m : meshes)
+        bytes += m.releasedBytes;
+    return bytes;
+}
+
+bool Model::RestoreCpuGeometry(const std::string& path)
+{
+    if (!ready || residency == MeshResidency::KeepCpu)
+        return ready;
+
+    // processMesh only keeps the unpacked vertices for KeepCpu
+    residency = MeshResidency::KeepCpu;
+    std::vector<MeshSource> sources;
+    if (!readSources(path, sources, NULL) || sources.size() != meshes.size())
+    {
+        residency = MeshResidency::GpuOnly;
+        return false;
+    }
+    for (size_t i = 0; i < sources.size(); i++)
+    {
+        if ((GLsizei)sources[i].vertices.size() != meshes[i].vertexCount || (GLsizei)sources[i].indices.size() != meshes[i].indexCount)
+        {
+            residency = MeshResidency::GpuOnly;
+            return false;
+        }
+    }
+    for (size_t i = 0; i < sources.size(); i++)
+    {
+        meshes[i].vertices = std::move(sources[i].vertices);
+        meshes[i].indices = std::move(sources[i].indices);
+        meshes[i].releasedBytes = 0;
+    }
+    return true;
+}
+
+const unsigned Model::IMPORT_FLAGS = aiProcess_Triangulate | aiProcess_FlipUVs | aiProcess_CalcTangentSpace;
+
+Model::Model(const char* path, MeshResidency residency, AssetLoader* loader, std::shared_ptr<const Model> placeholder)
+    : residency(residency), loader(loader), placeholder(std::move(placeholder))
+{
+    std::string source(path);
+    directory = source.substr(0, source.find_last_of('/'));
+}
+
 void Model::loadModel(std::string path)
 {
 #ifdef _DEBUG
     std::cout << "Loading model at " + path << std::endl;
 #endif
-    Assimp::Importer importer;
-    const aiScene* scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_FlipUVs | aiProcess_CalcTangentSpace);
-#ifdef _DEBUG
-    if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode)
+    directory = path.substr(0, path.find_last_of('/'));
+
+    // The cache only holds packed GPU data, so it can't serve KeepCpu models
+    std::shared_ptr<MappedFile> cache;
+    if (residency == MeshResidency::GpuOnly)
+        cache = MeshCache::Open(path, IMPORT_FLAGS);
+    if (cache)
     {
-        std::cout << "ERROR::ASSIMP::" << importer.GetErrorString() << std::endl;
+        for (uint32_t i = 0; i < MeshCache::GetMeshCount(*cache); i++)
+            MeshCache::LoadMesh(*cache, i, *this);
+        finishLoading();
+#ifdef _DEBUG
+        std::cout << "Model loaded from " << MeshCache::GetPath(path) << std::endl;
+#endif
         return;
     }
-#endif
-    directory = path.substr(0, path.find_last_of('/'));
 
-    processNode(scene->mRootNode, scene);
+    std::vector<MeshSource> sources;
+    if (readSources(path, sources, NULL))
+    {
+        MeshCache::Write(path, IMPORT_FLAGS, sources);
+        for (auto& source : sources)
+            addMesh(source);
+    }
+    finishLoading();
 #ifdef _DEBUG
     bool error = Window::check_errors();
     if (error)
         std::cout << "Error loading model!" << std::endl;
     else
         std::cout << "Model loaded with no errors" << std::endl;
+    if (residency == MeshResidency::GpuOnly)
+        std::cout << "Released " << GetReleasedBytes() / 1024 << " KB of CPU-side geometry" << std::endl;
+#endif
+}
+
+bool Model::readSources(const std::string& path, std::vector<MeshSource>& sources, ThreadPool* threadPool) const
+{
+    Assimp::Importer importer;
+    const aiScene* scene = importer.ReadFile(path, IMPORT_FLAGS);
+    if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode)
+    {
+#ifdef _DEBUG
+        std::cout << "ERROR::ASSIMP::" << importer.GetErrorString() << std::endl;
 #endif
+        return false;
+    }
+
+    std::vector<std::pair<aiMesh*, glm::mat4>> order;
+    processNode(scene->mRootNode, scene, glm::mat4(1.0f), order);
+    sources.resize(order.size());
+    // The scene is only read from here on, so meshes can be processed side by side
+    auto process = [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++)
+            processMesh(order[i].first, order[i].second, scene, sources[i]);
+    };
+    if (threadPool)
+        threadPool->ParallelFor(order.size(), process);
+    else
+        process(0, order.size());
+    return true;
 }
 
-void Model::processNode(aiNode* node, const aiScene* scene)
+void Model::processNode(aiNode* node, const aiScene* scene, const glm::mat4& parentTransform, std::vector<std::pair<aiMesh*, glm::mat4>>& order) const
 {
+    // aiMatrix4x4 is row-major
+    const aiMatrix4x4& m = node->mTransformation;
+    glm::mat4 local(glm::vec4(m.a1, m.b1, m.c1, m.d1), glm::vec4(m.a2, m.b2, m.c2, m.d2),
+        glm::vec4(m.a3, m.b3, m.c3, m.d3), glm::vec4(m.a4, m.b4, m.c4, m.d4));
+    glm::mat4 transform = parentTransform * local;
+
     for (GLuint i = 0; i < node->mNumMeshes; i++)
     {
-        aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
-        meshes.push_back(processMesh(mesh, scene));
+        order.push_back({ scene->mMeshes[node->mMeshes[i]], transform });
     }
 
     for (GLuint i = 0; i < node->mNumChildren; i++)
     {
-        processNode(node->mChildren[i], scene);
+        processNode(node->mChildren[i], scene, transform, order);
     }
 }
 
-Mesh Model::processMesh(aiMesh* mesh, const aiScene* scene)
+void Model::processMesh(aiMesh* mesh, const glm::mat4& transform, const aiScene* scene, MeshSource& source) const
 {
     std::vector<Vertex> vertices;
     std::vector<GLuint> indices;
-    std::vector<Texture> textures;
+    Bounds& meshBounds = source.bounds;
+    vertices.reserve(mesh->mNumVertices);
+    glm::mat3 tangentMatrix(transform);
+    glm::mat3 normalMatrix = glm::transpose(glm::inverse(tangentMatrix));
 
     for (GLuint i = 0; i < mesh->mNumVertices; i++)
     {
         Vertex vertex;
         aiVector3D position = mesh->mVertices[i];
-        vertex.Position = glm::vec3(position.x, position.y, position.z);
+        vertex.Position = glm::vec3(transform * glm::vec4(position.x, position.y, position.z, 1.0f));
+        meshBounds.extend(vertex.Position);
 
         aiVector3D normal = mesh->mNormals[i];
-        vertex.Normal = glm::vec3(normal.x, normal.y, normal.z);
+        vertex.Normal = glm::normalize(normalMatrix * glm::vec3(normal.x, normal.y, normal.z));
 
         if (mesh->mTextureCoords[0])
         {
             aiVector3D texcoords = mesh->mTextureCoords[0][i];
-            vertex.TexCoords = glm::vec3(texcoords.x, texcoords.y, texcoords.z);
+            vertex.TexCoords = glm::vec2(texcoords.x, texcoords.y);
         }
+        else
+            vertex.TexCoords = glm::vec2(0.0f);
 
         aiVector3D tangent = mesh->mTangents[i];
-        vertex.Tangent = glm::vec3(tangent.x, tangent.y, tangent.z);
+        vertex.Tangent = glm::normalize(tangentMatrix * glm::vec3(tangent.x, tangent.y, tangent.z));
 
         aiVector3D bitangent = mesh->mBitangents[i];
-        vertex.Bitangent = glm::vec3(bitangent.x, bitangent.y, bitangent.z);
+        vertex.Bitangent = glm::normalize(tangentMatrix * glm::vec3(bitangent.x, bitangent.y, bitangent.z));
         
         vertices.push_back(vertex);
     }
 
+    if (meshBounds.isValid())
+    {
+        meshBounds.center = (meshBounds.min + meshBounds.max) * 0.5f;
+        float radiusSq = 0.0f;
+        for (const auto& v : vertices)
+        {
+            glm::vec3 d = v.Position - meshBounds.center;
+            radiusSq = std::max(radiusSq, glm::dot(d, d));
+        }
+        meshBounds.radius = std::sqrt(radiusSq);
+    }
+
+    // A mirroring node transform turns the triangles inside out
+    bool flipWinding = glm::determinant(tangentMatrix) < 0.0f;
     for (GLuint i = 0; i < mesh->mNumFaces; i++)
     {
         aiFace face = mesh->mFaces[i];
         for (GLuint j = 0; j < face.mNumIndices; j++)
-            indices.push_back(face.mIndices[j]);
+            indices.push_back(face.mIndices[flipWinding ? face.mNumIndices - 1 - j : j]);
     }
 
     if (mesh->mMaterialIndex >= 0)
     {
         aiMaterial* material = scene->mMaterials[mesh->mMaterialIndex];
-        
-        std::vector<Texture> diffuseMaps = loadMaterialTextures(material, aiTextureType_DIFFUSE, "texture_diffuse");
-        textures.insert(textures.end(), diffuseMaps.begin(), diffuseMaps.end());
+        loadMaterialTextures(material, aiTextureType_DIFFUSE, "texture_diffuse", source.textures);
+        loadMaterialTextures(material, aiTextureType_SPECULAR, "texture_specular", source.textures);
+        loadMaterialTextures(material, aiTextureType_HEIGHT, "texture_normal", source.textures);
+        loadMaterialTextures(material, aiTextureType_AMBIENT, "texture_height", source.textures);
+    }
+
+    Mesh::Pack(vertices, indices, source.geometry);
+    if (residency == MeshResidency::KeepCpu)
+    {
+        source.vertices = std::move(vertices);
+        source.indices = std::move(indices);
+    }
+}
 
-        std::vector<Texture> specularMaps = loadMaterialTextures(material, aiTextureType_SPECULAR, "texture_specular");
-        textures.insert(textures.end(), specularMaps.begin(), specularMaps.end());
+void Model::addMesh(MeshSource& source)
+{
+    std::vector<Texture> textures;
+    textures.reserve(source.textures.size());
+    for (const auto& t : source.textures)
+        textures.push_back(loadTexture(t.path, t.type));
+
+    Mesh mesh(source.geometry, std::move(textures));
+    mesh.bounds = source.bounds;
+    if (residency == MeshResidency::KeepCpu)
+    {
+        mesh.vertices = std::move(source.vertices);
+        mesh.indices = std::move(source.indices);
+    }
+    else
+    {
+        mesh.releasedBytes = (size_t)mesh.vertexCount * sizeof(Vertex) + (size_t)mesh.indexCount * sizeof(GLuint);
+    }
+    // Uploaded, so the packed copy can go now rather than with the whole load
+    source.geometry = PackedGeometry();
+    meshes.push_back(std::move(mesh));
+}
 
-        std::vector<Texture> normalMaps = loadMaterialTextures(material, aiTextureType_HEIGHT, "texture_normal");
-        textures.insert(textures.end(), normalMaps.begin(), normalMaps.end());
+void Model::finishLoading()
+{
+    computeBounds();
+    ready = true;
+    loader = NULL;
+    placeholder.reset();
+}
 
-        std::vector<Texture> heightMaps = loadMaterialTextures(material, aiTextureType_AMBIENT, "texture_height");
-        textures.insert(textures.end(), heightMaps.begin(), heightMaps.end());
+void Model::computeBounds()
+{
+    for (const auto& m : meshes)
+    {
+        if (!m.bounds.isValid())
+            continue;
+        bounds.extend(m.bounds.min);
+        bounds.extend(m.bounds.max);
     }
+    if (!bounds.isValid())
+        return;
 
-    return Mesh(vertices, indices, textures);
+    // Enclose each mesh sphere, but never exceed the sphere around the whole box
+    bounds.center = (bounds.min + bounds.max) * 0.5f;
+    float radius = 0.0f;
+    for (const auto& m : meshes)
+    {
+        if (m.bounds.isValid())
+            radius = std::max(radius, glm::length(m.bounds.center - bounds.center) + m.bounds.radius);
+    }
+    bounds.radius = std::min(radius, glm::length(bounds.max - bounds.center));
 }
 
-std::vector<Texture> Model::loadMaterialTextures(aiMaterial* mat, aiTextureType type, std::string typeName)
+void Model::loadMaterialTextures(aiMaterial* mat, aiTextureType type, std::string typeName, std::vector<Texture>& textures) const
 {
-    std::vector<Texture> textures;
+    // Only the references; loadTexture resolves them on the GL thread
     for (GLuint i = 0; i < mat->GetTextureCount(type); i++)
     {
         aiString str;
         mat->GetTexture(type, i, &str);
-        bool skip = false;
-        for (GLuint j = 0; j < textures_loaded.size(); j++)
-        {
-            if (std::strcmp(textures_loaded[j].path.data(), str.C_Str()) == 0)
-            {
-                textures.push_back(textures_loaded[j]);
-                skip = true;
-                break;
-            }
-        }
-        if (!skip)
-        {
-            Texture texture;
-            const char* c_str = str.C_Str();
-            texture.id = TextureFromFile(c_str, directory);
-            texture.type = typeName;
-            texture.path = std::string(c_str);
-            textures.push_back(texture);
-            textures_loaded.push_back(texture);
-        }
+        Texture texture;
+        texture.id = 0;
+        texture.type = typeName;
+        texture.path = str.C_Str();
+        textures.push_back(texture);
     }
+}
 
-    return textures;
-}
\ No newline at end of file
+// Flat stand-ins shown until an image has streamed in: grey albedo, no
+// specular or height, and a normal map pointing straight out of the surface
+static glm::vec4 placeholderColor(const std::string& typeName)
+{
+    if (typeName == "texture_diffuse")
+        return glm::vec4(0.5f, 0.5f, 0.5f, 1.0f);
+    if (typeName == "texture_normal")
+        return glm::vec4(0.5f, 0.5f, 1.0f, 1.0f);
+    return glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+}
+
+Texture Model::loadTexture(const std::string& path, const std::string& typeName)
+{
+    Texture texture;
+    texture.resource = TextureCache::Get().Acquire(directory + '/' + path, CompressedTexture::RoleFromType(typeName),
+        false, 0, loader, placeholderColor(typeName));
+    texture.id = texture.resource->id;
+    texture.type = typeName;
+    texture.path = path;
+    return texture;
+}
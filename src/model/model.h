@@ -1,26 +1,71 @@
 #pragma once
 #include "../shaders/shader.h"
+#include <memory>
 #include <vector>
 #include <string>
 #include "../mesh/mesh.h"
+#include "../utils/threadpool.h"
 #include <assimp/Importer.hpp>
 #include <assimp/scene.h>
 #include <assimp/postprocess.h>
 
+class AssetLoader;
+
 class Model
 {
+    friend class MeshCache;
+    friend class AssetLoader;
 public:
     std::vector<Mesh> meshes;
+    // Union of every mesh's bounds
+    Bounds bounds;
 private:
-    std::vector<Texture> textures_loaded;
+    // Part of the mesh cache key, so changing these invalidates every cache
+    static const unsigned IMPORT_FLAGS;
+
     std::string directory;
+    MeshResidency residency;
+    bool ready = false;
+    // Set while an AssetLoader streams the model in; drawn until it is ready
+    AssetLoader* loader = NULL;
+    std::shared_ptr<const Model> placeholder;
 public:
-    Model(const char* path) { loadModel(path); }
-    void InstancedDraw(Shader& shader, int amount);
+    Model(const char* path, MeshResidency residency = MeshResidency::GpuOnly)
+        : residency(residency) { loadModel(path); }
+    // Starts empty and is filled in by loader over the following frames
+    Model(const char* path, MeshResidency residency, AssetLoader* loader, std::shared_ptr<const Model> placeholder);
+    // Draws amount instances whose InstanceData starts at offset in instanceBuffer.
+    // Leaves the arena's VAO bound for the next model; call
+    // GeometryArena::Get().Unbind() once the whole run of draws is done.
+    void InstancedDraw(Shader& shader, GLsizei amount, GLuint instanceBuffer, GLintptr offset) const;
     void Draw(Shader& shader) const;
+
+    inline MeshResidency GetResidency() const { return residency; }
+    inline bool IsReady() const { return ready; }
+    // What to render this frame: the model once loaded, its placeholder before
+    inline const Model& GetDrawable() const { return ready || !placeholder ? *this : *placeholder; }
+    // Host memory freed by discarding the meshes' CPU copies after upload
+    size_t GetReleasedBytes() const;
+    // Turns a loaded GpuOnly model into a KeepCpu one by reading the CPU
+    // geometry back from path; the GPU copy is left as it is. False if the
+    // model is still streaming or the file no longer matches its meshes.
+    bool RestoreCpuGeometry(const std::string& path);
 private:
     void loadModel(std::string path);
-    void processNode(aiNode* node, const aiScene* scene);
-    Mesh processMesh(aiMesh* mesh, const aiScene* scene);
-    std::vector<Texture> loadMaterialTextures(aiMaterial* mat, aiTextureType type, std::string typeName);
+    // Imports and packs every mesh without touching GL, so it can run on a
+    // worker; meshes are processed in parallel when threadPool is given.
+    // Writing the mesh cache is left to the caller, so RestoreCpuGeometry
+    // doesn't rewrite one that is already up to date.
+    bool readSources(const std::string& path, std::vector<MeshSource>& sources, ThreadPool* threadPool) const;
+    // Lists every mesh reference with its node's transform relative to the root
+    void processNode(aiNode* node, const aiScene* scene, const glm::mat4& parentTransform, std::vector<std::pair<aiMesh*, glm::mat4>>& order) const;
+    // Bakes transform into the vertices
+    void processMesh(aiMesh* mesh, const glm::mat4& transform, const aiScene* scene, MeshSource& source) const;
+    // GL thread: uploads one source and appends it to meshes
+    void addMesh(MeshSource& source);
+    void finishLoading();
+    void computeBounds();
+    void loadMaterialTextures(aiMaterial* mat, aiTextureType type, std::string typeName, std::vector<Texture>& textures) const;
+    // Loads a texture relative to the model's directory through the shared TextureCache
+    Texture loadTexture(const std::string& path, const std::string& typeName);
 };
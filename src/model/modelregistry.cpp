@@ -0,0 +1,171 @@
+#include "modelregistry.h"
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+
+ModelHandle ModelRegistry::Load(const std::string& path, MeshResidency residency)
+{
+    return load(path, residency, m_Loader != NULL);
+}
+
+ModelHandle ModelRegistry::LoadNow(const std::string& path, MeshResidency residency)
+{
+    return load(path, residency, false);
+}
+
+ModelHandle ModelRegistry::load(const std::string& path, MeshResidency residency, bool stream)
+{
+    auto byPath = m_ByPath.find(path);
+    if (byPath != m_ByPath.end())
+        return upgrade(byPath->second, path, residency, stream);
+
+    if (stream)
+    {
+        ModelHandle model = create(path, residency, true);
+        m_ByPath[path] = model;
+        m_Streamed[path] = model;
+        return model;
+    }
+
+    uint64_t hash;
+    if (!hashFile(path, hash))
+    {
+#ifdef _DEBUG
+        std::cout << "ERROR::MODELREGISTRY::Could not read " << path << std::endl;
+#endif
+        return create(path, residency, false);
+    }
+    std::string directory = canonicalDirectory(path);
+    hash = hashBytes(directory.data(), directory.size(), hash);
+
+    auto byContent = m_ByContent.find(hash);
+    if (byContent != m_ByContent.end())
+    {
+#ifdef _DEBUG
+        std::cout << "Model at " << path << " is a duplicate, reusing it" << std::endl;
+#endif
+        m_ByPath[path] = byContent->second;
+        return upgrade(byContent->second, path, residency, stream);
+    }
+
+    ModelHandle model = create(path, residency, false);
+    m_ByPath[path] = model;
+    m_ByContent[hash] = model;
+    return model;
+}
+
+size_t ModelRegistry::GetReleasedBytes() const
+{
+    size_t bytes = 0;
+    for (const auto& m : m_ByContent)
+        bytes += m.second->GetReleasedBytes();
+    for (const auto& m : m_Streamed)
+        bytes += m.second->GetReleasedBytes();
+    return bytes;
+}
+
+ModelHandle ModelRegistry::create(const std::string& path, MeshResidency residency, bool stream)
+{
+    if (stream)
+        return m_Loader->LoadModel(path, residency, m_Placeholder);
+    return std::make_shared<Model>(path.c_str(), residency);
+}
+
+// Loaded models get their CPU geometry back in place, so every handle
+// already given out sees it and the GPU copy is shared. A model still
+// streaming in can't be changed under the loader; it is loaded a second time
+// instead, and the registry switches to that copy. The first one stays in
+// memory until the handles to it are dropped.
+ModelHandle ModelRegistry::upgrade(const ModelHandle& model, const std::string& path, MeshResidency residency, bool stream)
+{
+    if (residency == MeshResidency::GpuOnly || model->GetResidency() == MeshResidency::KeepCpu)
+        return model;
+    if (model->RestoreCpuGeometry(path))
+        return model;
+
+    ModelHandle old = model;
+    ModelHandle upgraded = create(path, residency, stream);
+    for (auto& p : m_ByPath)
+    {
+        if (p.second == old)
+            p.second = upgraded;
+    }
+    for (auto& c : m_ByContent)
+    {
+        if (c.second == old)
+            c.second = upgraded;
+    }
+    for (auto& s : m_Streamed)
+    {
+        if (s.second == old)
+            s.second = upgraded;
+    }
+    return upgraded;
+}
+
+void ModelRegistry::Collect()
+{
+    // References the registry holds itself: one per path plus one content
+    // or streamed entry
+    std::unordered_map<const Model*, long> owned;
+    for (const auto& p : m_ByPath)
+        owned[p.second.get()]++;
+
+    for (auto it = m_ByContent.begin(); it != m_ByContent.end();)
+    {
+        if (it->second.use_count() == owned[it->second.get()] + 1)
+            it = m_ByContent.erase(it);
+        else
+            ++it;
+    }
+    for (auto it = m_Streamed.begin(); it != m_Streamed.end();)
+    {
+        if (it->second.use_count() == owned[it->second.get()] + 1)
+            it = m_Streamed.erase(it);
+        else
+            ++it;
+    }
+    for (auto it = m_ByPath.begin(); it != m_ByPath.end();)
+    {
+        if (it->second.use_count() <= owned[it->second.get()])
+            it = m_ByPath.erase(it);
+        else
+            ++it;
+    }
+}
+
+// FNV-1a over the raw file bytes
+bool ModelRegistry::hashFile(const std::string& path, uint64_t& hash)
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file)
+        return false;
+
+    hash = 14695981039346656037ull;
+    char buffer[4096];
+    while (file.read(buffer, sizeof(buffer)) || file.gcount() > 0)
+        hash = hashBytes(buffer, (size_t)file.gcount(), hash);
+    return true;
+}
+
+// Two paths to one directory give the same string, so only files that would
+// also resolve the same materials and textures share a key
+std::string ModelRegistry::canonicalDirectory(const std::string& path)
+{
+    std::error_code error;
+    std::filesystem::path directory = std::filesystem::absolute(path, error).parent_path();
+    std::filesystem::path canonical = std::filesystem::weakly_canonical(directory, error);
+    if (error)
+        return directory.generic_string();
+    return canonical.generic_string();
+}
+
+uint64_t ModelRegistry::hashBytes(const char* data, size_t size, uint64_t hash)
+{
+    for (size_t i = 0; i < size; i++)
+    {
+        hash ^= (unsigned char)data[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
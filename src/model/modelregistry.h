@@ -0,0 +1,52 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+#include "model.h"
+#include "assetloader.h"
+
+// Shared handle to a loaded model. Renderables hold these instead of copies,
+// so a scene's geometry grows with its unique assets, not its instances.
+typedef std::shared_ptr<Model> ModelHandle;
+
+// Loads each model once and hands out shared handles to it.
+// Requests are deduplicated by path first, then by a hash of the file's
+// contents and its directory, so the same asset saved under two names is only
+// uploaded once. The directory is part of the key because the .mtl and
+// textures an .obj names are resolved relative to it.
+// With an AssetLoader, Load streams models in and only dedups by path, since
+// hashing the contents would read the whole file on the calling thread.
+class ModelRegistry
+{
+private:
+    std::unordered_map<std::string, ModelHandle> m_ByPath;
+    std::unordered_map<uint64_t, ModelHandle> m_ByContent;
+    // Streamed models, which have no content hash
+    std::unordered_map<std::string, ModelHandle> m_Streamed;
+    AssetLoader* m_Loader;
+    ModelHandle m_Placeholder;
+public:
+    ModelRegistry(AssetLoader* loader = NULL) : m_Loader(loader) {}
+
+    // A model first loaded GpuOnly gets its CPU geometry back if a later caller needs KeepCpu
+    ModelHandle Load(const std::string& path, MeshResidency residency = MeshResidency::GpuOnly);
+    // Loads on the calling thread even when a loader is set
+    ModelHandle LoadNow(const std::string& path, MeshResidency residency = MeshResidency::GpuOnly);
+    // Drawn in place of streamed models until they are ready
+    inline void SetPlaceholder(const ModelHandle& placeholder) { m_Placeholder = placeholder; }
+    // Drops models that only the registry still references
+    void Collect();
+
+    inline size_t GetModelCount() const { return m_ByContent.size() + m_Streamed.size(); }
+    // Host memory saved across every loaded model by releasing CPU geometry
+    size_t GetReleasedBytes() const;
+private:
+    ModelHandle load(const std::string& path, MeshResidency residency, bool stream);
+    ModelHandle create(const std::string& path, MeshResidency residency, bool stream);
+    ModelHandle upgrade(const ModelHandle& model, const std::string& path, MeshResidency residency, bool stream);
+    static bool hashFile(const std::string& path, uint64_t& hash);
+    static std::string canonicalDirectory(const std::string& path);
+    static uint64_t hashBytes(const char* data, size_t size, uint64_t hash = 14695981039346656037ull);
+};
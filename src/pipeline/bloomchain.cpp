@@ -0,0 +1,90 @@
+#include "bloomchain.h"
+
+BloomChain::BloomChain(GLsizei width, GLsizei height, GLuint levels)
+{
+    // Halve, rounding up, until MAX_LEVELS or a level would be a single texel wide
+    GLsizei levelWidth = (width + 1) / 2, levelHeight = (height + 1) / 2;
+    while (m_Levels.size() < MAX_LEVELS && levelWidth > 1 && levelHeight > 1)
+    {
+        m_Levels.emplace_back();
+        Level& level = m_Levels.back();
+        level.width = levelWidth;
+        level.height = levelHeight;
+        level.framebuffer.attachColorBuffers(1, levelWidth, levelHeight, GL_RGBA16F);
+        levelWidth = (levelWidth + 1) / 2;
+        levelHeight = (levelHeight + 1) / 2;
+    }
+    SetLevels(levels);
+    // FinalPass reads the result without the sampler, stretched to full size
+    GLState::BindTexture(GL_TEXTURE_2D, m_Levels[0].framebuffer.colorBuffers[0]);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+    glGenSamplers(1, &m_Sampler);
+    glSamplerParameteri(m_Sampler, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glSamplerParameteri(m_Sampler, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glSamplerParameteri(m_Sampler, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glSamplerParameteri(m_Sampler, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+}
+
+BloomChain::~BloomChain()
+{
+    glDeleteSamplers(1, &m_Sampler);
+    for (Level& level : m_Levels)
+    {
+        GLState::DeleteTextures(1, &level.framebuffer.colorBuffers[0]);
+        GLState::DeleteFramebuffers(1, &level.framebuffer.ID);
+    }
+}
+
+void BloomChain::SetLevels(GLuint levels)
+{
+    GLuint allocated = (GLuint)m_Levels.size();
+    m_LevelCount = levels < 1 ? 1 : (levels > allocated ? allocated : levels);
+}
+
+GLuint BloomChain::Render(GLuint source, Shader& downsample, Shader& upsample, VertexArray& quad)
+{
+    GLint viewport[4];
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    glBindSampler(0, m_Sampler);
+    quad.bind();
+
+    // 1. Downsample: level 0 thresholds the scene, every later level halves
+    // the one before it
+    // -----------------------------------------------------------------------
+    downsample.use();
+    GLuint input = source;
+    for (GLuint i = 0; i < m_LevelCount; i++)
+    {
+        Level& level = m_Levels[i];
+        Framebuffer::bind(level.framebuffer.ID);
+        glViewport(0, 0, level.width, level.height);
+        downsample.setBool("extractBright", i == 0);
+        GLState::BindTexture(0, GL_TEXTURE_2D, input);
+        glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+        input = level.framebuffer.colorBuffers[0];
+    }
+
+    // 2. Upsample: add each level, blurred, onto the one above, so level 0
+    // ends up with every level's contribution
+    // ---------------------------------------------------------------------
+    upsample.use();
+    upsample.setFloat("radius", m_Radius);
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_ONE, GL_ONE);
+    for (GLuint i = m_LevelCount - 1; i > 0; i--)
+    {
+        Level& level = m_Levels[i - 1];
+        Framebuffer::bind(level.framebuffer.ID);
+        glViewport(0, 0, level.width, level.height);
+        GLState::BindTexture(0, GL_TEXTURE_2D, m_Levels[i].framebuffer.colorBuffers[0]);
+        glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+    }
+    glDisable(GL_BLEND);
+
+    VertexArray::unbind();
+    glBindSampler(0, 0);
+    glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+    return m_Levels[0].framebuffer.colorBuffers[0];
+}
@@ -0,0 +1,49 @@
+#pragma once
+#include <glad/glad.h>
+#include <vector>
+
+#include "../buffers/framebuffer.h"
+#include "../buffers/vertexarray.h"
+#include "../shaders/shader.h"
+
+// Bloom as a chain of successively halved images (Jimenez, "Next Generation
+// Post Processing in Call of Duty: Advanced Warfare").
+//
+// Render() keeps the bright parts of the lit scene at half resolution and
+// halves them again with a 13-tap filter (BloomDownsample.frag) once per
+// level. It then walks back up, adding a tent-filtered copy of each level
+// onto the one above it (BloomUpsample.frag). Each pass covers a quarter of
+// the pixels of the one before, so the glow gets wider with every level while
+// the whole chain costs less than one full-resolution pass.
+class BloomChain
+{
+public:
+    // Levels allocated up front; SetLevels() can only choose fewer
+    static const GLuint MAX_LEVELS = 8;
+private:
+    struct Level
+    {
+        Framebuffer framebuffer;
+        GLsizei width, height;
+    };
+
+    std::vector<Level> m_Levels;
+    GLuint m_LevelCount;
+    float m_Radius = 1.0f;
+    // Linear, clamped: the filters' taps rely on bilinear fetches, and the
+    // lit scene's own texture is nearest
+    GLuint m_Sampler;
+public:
+    BloomChain(GLsizei width, GLsizei height, GLuint levels = 6);
+    ~BloomChain();
+
+    // source is sampled on unit 0. Returns the half resolution result.
+    GLuint Render(GLuint source, Shader& downsample, Shader& upsample, VertexArray& quad);
+
+    // Clamped to [1, allocated levels]
+    void SetLevels(GLuint levels);
+    // Tent filter radius, in texels of the level being upsampled
+    inline void SetRadius(float radius) { m_Radius = radius; }
+    inline GLuint GetLevelCount() const { return m_LevelCount; }
+    inline float GetRadius() const { return m_Radius; }
+};
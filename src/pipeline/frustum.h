@@ -0,0 +1,93 @@
+#pragma once
+#include <glm/glm.hpp>
+#include <cstddef>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define FRUSTUM_SSE 1
+#endif
+
+// View frustum as six inward-facing planes, used to cull bounding spheres.
+class Frustum
+{
+private:
+    // Plane i is (x, y, z, w)[i]: dot(n, p) + d >= 0 inside.
+    // Stored one component per array so the SIMD test can splat them.
+    float m_X[6], m_Y[6], m_Z[6], m_W[6];
+public:
+    // Gribb-Hartmann: each plane is a sum or difference of the matrix's rows
+    void Extract(const glm::mat4& viewProjection)
+    {
+        glm::vec4 row[4];
+        for (int i = 0; i < 4; i++)
+            row[i] = glm::vec4(viewProjection[0][i], viewProjection[1][i], viewProjection[2][i], viewProjection[3][i]);
+
+        glm::vec4 planes[6] = {
+            row[3] + row[0], row[3] - row[0],   // left, right
+            row[3] + row[1], row[3] - row[1],   // bottom, top
+            row[3] + row[2], row[3] - row[2]    // near, far
+        };
+        for (int i = 0; i < 6; i++)
+        {
+            // Normalized so the plane distance can be compared with a radius
+            glm::vec4 p = planes[i] / glm::length(glm::vec3(planes[i]));
+            m_X[i] = p.x;
+            m_Y[i] = p.y;
+            m_Z[i] = p.z;
+            m_W[i] = p.w;
+        }
+    }
+
+    // Sets visible[i] for every sphere (xyz centre, w radius) that is at least
+    // partly inside, clears it otherwise, and returns how many are visible.
+    size_t CullSpheres(const glm::vec4* spheres, size_t count, char* visible) const
+    {
+        size_t visibleCount = 0;
+        size_t i = 0;
+#ifdef FRUSTUM_SSE
+        // Four spheres at a time: transpose to x/y/z/r lanes, then one
+        // multiply-add chain per plane
+        for (; i + 4 <= count; i += 4)
+        {
+            __m128 x = _mm_loadu_ps(&spheres[i].x);
+            __m128 y = _mm_loadu_ps(&spheres[i + 1].x);
+            __m128 z = _mm_loadu_ps(&spheres[i + 2].x);
+            __m128 r = _mm_loadu_ps(&spheres[i + 3].x);
+            _MM_TRANSPOSE4_PS(x, y, z, r);
+            __m128 negR = _mm_sub_ps(_mm_setzero_ps(), r);
+
+            __m128 inside = _mm_cmpeq_ps(negR, negR);
+            for (int p = 0; p < 6; p++)
+            {
+                __m128 d = _mm_add_ps(
+                    _mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(m_X[p])), _mm_mul_ps(y, _mm_set1_ps(m_Y[p]))),
+                    _mm_add_ps(_mm_mul_ps(z, _mm_set1_ps(m_Z[p])), _mm_set1_ps(m_W[p])));
+                inside = _mm_and_ps(inside, _mm_cmpge_ps(d, negR));
+            }
+
+            int mask = _mm_movemask_ps(inside);
+            for (int k = 0; k < 4; k++)
+            {
+                visible[i + k] = (mask >> k) & 1;
+                visibleCount += visible[i + k];
+            }
+        }
+#endif
+        for (; i < count; i++)
+        {
+            visible[i] = ContainsSphere(spheres[i]);
+            visibleCount += visible[i];
+        }
+        return visibleCount;
+    }
+
+    bool ContainsSphere(const glm::vec4& sphere) const
+    {
+        for (int p = 0; p < 6; p++)
+        {
+            if (m_X[p] * sphere.x + m_Y[p] * sphere.y + m_Z[p] * sphere.z + m_W[p] < -sphere.w)
+                return false;
+        }
+        return true;
+    }
+};
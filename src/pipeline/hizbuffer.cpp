@@ -0,0 +1,200 @@
+#include "hizbuffer.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+
+HiZBuffer::HiZBuffer(GLsizei width, GLsizei height, ThreadPool* threadPool)
+    : m_ThreadPool(threadPool),
+    m_Width((width + REDUCTION - 1) / REDUCTION), m_Height((height + REDUCTION - 1) / REDUCTION)
+{
+    m_Framebuffer.attachColorBuffers(1, m_Width, m_Height, GL_R32F);
+    for (auto& readback : m_Readbacks)
+        readback.buffer = new Buffer(GL_PIXEL_PACK_BUFFER, m_Width * m_Height * sizeof(float), NULL, GL_STREAM_READ);
+
+    // Each level halves, rounding up, so texel i of level l covers level 0
+    // texels [i << l, (i + 1) << l)
+    GLsizei levelWidth = m_Width, levelHeight = m_Height;
+    while (true)
+    {
+        m_Levels.push_back({ levelWidth, levelHeight, std::vector<float>((size_t)levelWidth * levelHeight, 1.0f) });
+        if (levelWidth == 1 && levelHeight == 1)
+            break;
+        levelWidth = (levelWidth + 1) / 2;
+        levelHeight = (levelHeight + 1) / 2;
+    }
+}
+
+HiZBuffer::~HiZBuffer()
+{
+    for (auto& readback : m_Readbacks)
+    {
+        if (readback.fence)
+            glDeleteSync(readback.fence);
+        delete readback.buffer;
+    }
+    GLState::DeleteTextures(1, &m_Framebuffer.colorBuffers[0]);
+    GLState::DeleteFramebuffers(1, &m_Framebuffer.ID);
+}
+
+void HiZBuffer::Build(GLuint positions, GLuint normals, const glm::mat4& viewProjection, Shader& shader, VertexArray& quad)
+{
+    Readback& readback = m_Readbacks[m_NextReadback];
+    // Still unconsumed from READBACKS frames ago: drop it rather than wait
+    if (readback.fence)
+        glDeleteSync(readback.fence);
+
+    // 1. Farthest depth of every REDUCTION x REDUCTION block; the target has
+    // no depth attachment, so depth testing is a no-op here
+    // ------------------------------------------------------------------------
+    GLint viewport[4];
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    Framebuffer::bind(m_Framebuffer.ID);
+    glViewport(0, 0, m_Width, m_Height);
+    shader.use();
+    shader.setMat4("viewProjection", viewProjection);
+    GLState::BindTexture(0, GL_TEXTURE_2D, positions);
+    GLState::BindTexture(1, GL_TEXTURE_2D, normals);
+    quad.bind();
+    glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+    GLState::BindVertexArray(0);
+
+    // 2. Queue the copy; the fence tells Update() when it has landed
+    // ---------------------------------------------------------------
+    readback.buffer->bind();
+    glReadBuffer(GL_COLOR_ATTACHMENT0);
+    glReadPixels(0, 0, m_Width, m_Height, GL_RED, GL_FLOAT, 0);
+    readback.buffer->unbind();
+    readback.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    readback.viewProjection = viewProjection;
+    m_NextReadback = (m_NextReadback + 1) % READBACKS;
+
+    glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+}
+
+bool HiZBuffer::Update()
+{
+    // Newest signaled readback wins, older ones are simply discarded. Last
+    // frame's has rarely signaled yet, so this is usually the one before it.
+    Readback* newest = NULL;
+    for (GLuint i = 0; i < READBACKS; i++)
+    {
+        Readback& readback = m_Readbacks[(m_NextReadback + i) % READBACKS];
+        if (!readback.fence)
+            continue;
+        if (glClientWaitSync(readback.fence, 0, 0) == GL_TIMEOUT_EXPIRED)
+            break;
+        glDeleteSync(readback.fence);
+        readback.fence = NULL;
+        newest = &readback;
+    }
+    if (!newest)
+        return false;
+
+    newest->buffer->bind();
+    const void* data = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, m_Width * m_Height * sizeof(float), GL_MAP_READ_BIT);
+    if (data)
+    {
+        std::memcpy(m_Levels[0].depth.data(), data, m_Levels[0].depth.size() * sizeof(float));
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    }
+    newest->buffer->unbind();
+    if (!data)
+        return false;
+
+    m_ViewProjection = newest->viewProjection;
+    buildLevels();
+    m_Ready = true;
+    return true;
+}
+
+size_t HiZBuffer::CullSpheres(const glm::vec4* spheres, size_t count, char* visible) const
+{
+    if (!m_Ready)
+        return (size_t)std::count(visible, visible + count, 1);
+
+    auto cull = [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++)
+        {
+            if (visible[i] && isOccluded(spheres[i]))
+                visible[i] = 0;
+        }
+    };
+    if (m_ThreadPool)
+        m_ThreadPool->ParallelFor(count, cull, 256);
+    else
+        cull(0, count);
+    return (size_t)std::count(visible, visible + count, 1);
+}
+
+// Projects the sphere's box with the pyramid's view-projection, then compares
+// its nearest depth with the farthest depth under its screen rectangle, read
+// from the level where that rectangle spans at most two texels.
+bool HiZBuffer::isOccluded(const glm::vec4& sphere) const
+{
+    if (sphere.w == FLT_MAX)
+        return false;
+
+    // The corners are the projected centre plus or minus the scaled matrix
+    // columns, so only the centre needs a full transform
+    glm::vec4 center = m_ViewProjection * glm::vec4(glm::vec3(sphere), 1.0f);
+    glm::vec4 axes[3] = { m_ViewProjection[0] * sphere.w, m_ViewProjection[1] * sphere.w, m_ViewProjection[2] * sphere.w };
+    glm::vec3 ndcMin(FLT_MAX), ndcMax(-FLT_MAX);
+    for (int corner = 0; corner < 8; corner++)
+    {
+        glm::vec4 clip = center;
+        clip += (corner & 1) ? axes[0] : -axes[0];
+        clip += (corner & 2) ? axes[1] : -axes[1];
+        clip += (corner & 4) ? axes[2] : -axes[2];
+        // Reaching behind the camera: nothing sensible to project
+        if (clip.w <= 0.0f)
+            return false;
+        glm::vec3 ndc = glm::vec3(clip) / clip.w;
+        ndcMin = glm::min(ndcMin, ndc);
+        ndcMax = glm::max(ndcMax, ndc);
+    }
+    // Crossing the near plane, or outside the view the pyramid saw
+    if (ndcMin.z < -1.0f || ndcMax.x < -1.0f || ndcMin.x > 1.0f || ndcMax.y < -1.0f || ndcMin.y > 1.0f)
+        return false;
+
+    float x0 = std::max(ndcMin.x * 0.5f + 0.5f, 0.0f) * m_Width;
+    float x1 = std::min(ndcMax.x * 0.5f + 0.5f, 1.0f) * m_Width;
+    float y0 = std::max(ndcMin.y * 0.5f + 0.5f, 0.0f) * m_Height;
+    float y1 = std::min(ndcMax.y * 0.5f + 0.5f, 1.0f) * m_Height;
+    float extent = std::max(x1 - x0, y1 - y0);
+    int level = extent > 2.0f ? (int)std::ceil(std::log2(extent * 0.5f)) : 0;
+    level = std::min(level, (int)m_Levels.size() - 1);
+
+    const Level& l = m_Levels[level];
+    int tx0 = std::min((int)x0 >> level, l.width - 1);
+    int tx1 = std::min((int)x1 >> level, l.width - 1);
+    int ty0 = std::min((int)y0 >> level, l.height - 1);
+    int ty1 = std::min((int)y1 >> level, l.height - 1);
+    float farthest = 0.0f;
+    for (int y = ty0; y <= ty1; y++)
+        for (int x = tx0; x <= tx1; x++)
+            farthest = std::max(farthest, l.depth[(size_t)y * l.width + x]);
+
+    float nearest = ndcMin.z * 0.5f + 0.5f;
+    return nearest > farthest;
+}
+
+void HiZBuffer::buildLevels()
+{
+    for (size_t i = 1; i < m_Levels.size(); i++)
+    {
+        const Level& src = m_Levels[i - 1];
+        Level& dst = m_Levels[i];
+        for (GLsizei y = 0; y < dst.height; y++)
+        {
+            const float* row0 = &src.depth[(size_t)(2 * y) * src.width];
+            const float* row1 = &src.depth[(size_t)std::min(2 * y + 1, src.height - 1) * src.width];
+            for (GLsizei x = 0; x < dst.width; x++)
+            {
+                GLsizei x0 = 2 * x, x1 = std::min(2 * x + 1, src.width - 1);
+                dst.depth[(size_t)y * dst.width + x] = std::max(std::max(row0[x0], row0[x1]), std::max(row1[x0], row1[x1]));
+            }
+        }
+    }
+}
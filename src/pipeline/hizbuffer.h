@@ -0,0 +1,72 @@
+#pragma once
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <vector>
+
+#include "../buffers/buffer.h"
+#include "../buffers/framebuffer.h"
+#include "../buffers/vertexarray.h"
+#include "../shaders/shader.h"
+#include "../utils/threadpool.h"
+
+// Hierarchical depth for occlusion culling against the previous frame.
+//
+// Build() reduces the G-buffer on the GPU to a quarter-resolution farthest
+// depth image (HiZ.frag) and reads it back into a pixel pack buffer without
+// waiting. Update() picks up the newest readback whose fence has already
+// signaled and builds the rest of the max-depth pyramid on the CPU, so nothing
+// ever stalls on the GPU. CullSpheres() then tests bounding spheres against
+// the pyramid with the view-projection it was rendered with.
+//
+// Update() runs at the start of a frame, before the GPU has usually finished
+// the previous frame, so the pyramid is typically READBACKS frames old: an
+// object coming out from behind its occluder shows up that many frames late.
+// If the GPU falls further behind than that, every readback is dropped before
+// it lands and the last pyramid stays in use until one gets through.
+class HiZBuffer
+{
+public:
+    // Full-resolution pixels per Hi-Z texel along each axis
+    static const GLsizei REDUCTION = 4;
+    // Readbacks in flight, and so the usual age of the pyramid in frames
+    static const GLuint READBACKS = 2;
+private:
+    struct Level
+    {
+        GLsizei width, height;
+        std::vector<float> depth;
+    };
+    struct Readback
+    {
+        Buffer* buffer;
+        GLsync fence = NULL;
+        glm::mat4 viewProjection;
+    };
+
+    ThreadPool* m_ThreadPool;
+    Framebuffer m_Framebuffer;
+    GLsizei m_Width, m_Height;
+    Readback m_Readbacks[READBACKS];
+    GLuint m_NextReadback = 0;
+
+    std::vector<Level> m_Levels;
+    glm::mat4 m_ViewProjection;
+    bool m_Ready = false;
+public:
+    HiZBuffer(GLsizei width, GLsizei height, ThreadPool* threadPool = NULL);
+    ~HiZBuffer();
+
+    // positions and normals are the G-buffer textures HiZ.frag samples on
+    // units 0 and 1; with the compact layout positions is the depth texture
+    void Build(GLuint positions, GLuint normals, const glm::mat4& viewProjection, Shader& shader, VertexArray& quad);
+    // Returns whether a newer pyramid is in use
+    bool Update();
+    // Clears visible[i] for every visible sphere (xyz centre, w radius) that is
+    // behind the pyramid's depth, and returns how many are left visible
+    size_t CullSpheres(const glm::vec4* spheres, size_t count, char* visible) const;
+
+    inline bool IsReady() const { return m_Ready; }
+private:
+    bool isOccluded(const glm::vec4& sphere) const;
+    void buildLevels();
+};
@@ -1,10 +1,24 @@
 #pragma once
 #include <queue>
+#include <cmath>
+#include <algorithm>
+#include <unordered_map>
 
+#include "frustum.h"
+#include "bloomchain.h"
+#include "hizbuffer.h"
+#include "renderqueue.h"
 #include "../buffers/framebuffer.h"
+#include "../utils/glstate.h"
+#include "../buffers/indexbuffer.h"
+#include "../buffers/vertexarray.h"
 #include "../window/window.h"
 #include "../renderables/Renderable.h"
 #include "../renderables/Emissive.h"
+#include "../lights/lightbuffer.h"
+#include "../lights/lightclusters.h"
+#include "../utils/threadpool.h"
+#include "../benchmark/profiler.h"
 
 static float quadVertices[] = {
     // positions        // texture Coords
@@ -14,47 +28,211 @@ static float quadVertices[] = {
      1.0f, -1.0f, 0.0f, 1.0f, 0.0f,
 };
 
+enum class LightingMode
+{
+    // Every pixel evaluates every light
+    Brute,
+    // Lights are binned into view-space clusters on the CPU first
+    Clustered,
+    // Each light rasterizes its bounding sphere, stencil-masked to the
+    // pixels whose surface lies inside it (see LightVolumePass)
+    Volumes
+};
+
+enum class GBufferLayout
+{
+    // RGBA16F position, normal and albedo+specular
+    Full,
+    // Position rebuilt from the depth texture, RG16 octahedral normal,
+    // RGBA8 albedo+specular. Shaders need COMPACT_GBUFFER (see GBuffer.glsl).
+    Compact
+};
+
+enum class BloomMode
+{
+    // Ten full-resolution separable Gaussian passes (BlurPass)
+    Gaussian,
+    // Progressive downsample/upsample chain (BloomPass, see BloomChain)
+    MipChain
+};
+
 class Pipeline
 {
 private:
-    std::vector<Renderable> m_GeometryList;
+    // A run of instances that share a model, drawn with one instanced call per mesh
+    struct InstanceBatch
+    {
+        const Model* model;
+        GLuint first;
+        GLsizei count;
+    };
+    static const GLuint RENDER_PASSES = 2;
+
+    std::vector<const Renderable*> m_GeometryList;
     std::vector<Light*> m_LightList;
-    std::vector<Emissive> m_EmissiveList;
+    std::vector<const Emissive*> m_EmissiveList;
+    LightBuffer m_LightBuffer;
+    ThreadPool m_ThreadPool;
+    LightClusters m_LightClusters;
+    LightingMode m_LightingMode = LightingMode::Clustered;
+
+    Frustum m_Frustum;
+    // World-space bounding spheres of the queue being culled, xyz centre and w radius
+    std::vector<glm::vec4> m_CullSpheres;
+    std::vector<char> m_GeometryVisible;
+    std::vector<char> m_EmissiveVisible;
+    bool m_FrustumCulling = true;
+    HiZBuffer m_HiZ;
+    bool m_OcclusionCulling = false;
+    bool m_DepthPrepass = false;
+
+    RenderQueue m_RenderQueue;
+    // Dense per-frame ids for the key's model and material fields
+    std::unordered_map<const Model*, GLuint> m_ModelIds;
+    std::unordered_map<GLuint, GLuint> m_MaterialIds;
+    Buffer m_InstanceBuffer;
+    std::vector<InstanceData> m_Instances;
+    std::vector<InstanceBatch> m_Batches;
+    // Batches of pass p are [m_PassBatches[p], m_PassBatches[p + 1])
+    size_t m_PassBatches[RENDER_PASSES + 1] = {};
 
     Framebuffer m_PingPongFBO[2];
+    BloomChain m_BloomChain;
+    BloomMode m_BloomMode = BloomMode::MipChain;
     Framebuffer m_GBuffer;
+    // The lighting target's color with the G-buffer's depth, for the light boxes
+    Framebuffer m_LightBoxFBO;
+    GBufferLayout m_GBufferLayout;
+    // What GBuffer.glsl samples on units 0-2: position (or depth), normal, albedo+specular
+    GLuint m_GBufferTextures[3];
 
     VertexArray m_QuadVAO;
+    VertexArray m_SphereVAO;
+    IndexBuffer* m_SphereIndices = NULL;
+    // The tessellated sphere sits inside the unit sphere between its vertices
+    float m_SphereScale = 1.0f;
+    GLuint m_DefaultFramebuffer;
+    GLsizei m_Width, m_Height;
+    Profiler* m_Profiler = NULL;
 
     glm::mat4 m_Projection;
     glm::mat4 m_View;
     glm::mat4 m_Model;
+    const float m_NearPlane = 0.1f;
+    const float m_FarPlane = 100.0f;
 public:
-    Pipeline(Window& window)
+    Pipeline(Window& window, GBufferLayout gBufferLayout = GBufferLayout::Compact)
+        : m_LightClusters(&m_ThreadPool),
+        m_HiZ(window.getWidth(), window.getHeight(), &m_ThreadPool),
+        m_InstanceBuffer(GL_ARRAY_BUFFER, sizeof(InstanceData), NULL, GL_STREAM_DRAW),
+        m_BloomChain(window.getWidth(), window.getHeight()),
+        m_GBufferLayout(gBufferLayout),
+        m_DefaultFramebuffer(window.getDefaultFramebuffer()),
+        m_Width(window.getWidth()), m_Height(window.getHeight())
     {
         Buffer* quadBuffer = new Buffer(GL_ARRAY_BUFFER, sizeof(quadVertices), &quadVertices);
         m_QuadVAO.addBuffer(quadBuffer, 0, 3, 5 * sizeof(float), 0);
         m_QuadVAO.addBuffer(quadBuffer, 1, 2, 5 * sizeof(float), (void*)(3 * sizeof(float)));
 
-        m_GBuffer.attachColorBuffers(3, window.getWidth(), window.getHeight());
-        m_GBuffer.attachDepthBuffer(window.getWidth(), window.getHeight());
+        initSphere(12, 24);
+
+        // Depth-stencil in both layouts: the light volumes need the stencil, and
+        // their target either shares it or gets the depth blitted into a
+        // matching format (see prepareVolumeDepth)
+        if (m_GBufferLayout == GBufferLayout::Compact)
+        {
+            m_GBuffer.attachColorBuffers({ GL_RG16, GL_RGBA8 }, window.getWidth(), window.getHeight());
+            m_GBuffer.attachDepthTexture(window.getWidth(), window.getHeight(), GL_DEPTH24_STENCIL8);
+            m_GBufferTextures[0] = m_GBuffer.depthTexture;
+            m_GBufferTextures[1] = m_GBuffer.colorBuffers[0];
+            m_GBufferTextures[2] = m_GBuffer.colorBuffers[1];
+        }
+        else
+        {
+            m_GBuffer.attachColorBuffers(3, window.getWidth(), window.getHeight());
+            m_GBuffer.attachDepthBuffer(window.getWidth(), window.getHeight(), GL_DEPTH24_STENCIL8);
+            for (int i = 0; i < 3; i++)
+                m_GBufferTextures[i] = m_GBuffer.colorBuffers[i];
+        }
 
         m_PingPongFBO[0].attachColorBuffers(1, window.getWidth(), window.getHeight());
         m_PingPongFBO[1].attachColorBuffers(1, window.getWidth(), window.getHeight());
-        //GLuint gPosition = m_GBuffer.colorBuffers[0];
-        //GLuint gNormal = m_GBuffer.colorBuffers[1];
-        //GLuint gAlbedoSpec = m_GBuffer.colorBuffers[2];
+    }
+    ~Pipeline()
+    {
+        delete m_SphereIndices;
     }
 
     void UpdateProjectionView(Camera& camera, Window& window)
     {
-        m_Projection = glm::perspective(glm::radians(camera.Fov), window.getAspectRatio(), 0.1f, 100.0f);
+        m_Projection = glm::perspective(glm::radians(camera.Fov), window.getAspectRatio(), m_NearPlane, m_FarPlane);
         m_View = camera.getView();
     }
 
-    void PushToGeometryQueue(Renderable& model)
+    void SetProfiler(Profiler* profiler)
     {
-        m_GeometryList.push_back(model);
+        m_Profiler = profiler;
+    }
+
+    // The lighting shader passed to LightingPass must match: Clustered needs
+    // DeferredShading.frag compiled with CLUSTERED defined.
+    void SetLightingMode(LightingMode mode)
+    {
+        m_LightingMode = mode;
+    }
+
+    void SetFrustumCulling(bool enabled)
+    {
+        m_FrustumCulling = enabled;
+    }
+
+    // Also drops renderables hidden behind last frame's depth (see HiZBuffer).
+    // Needs OcclusionPass every frame; only applies while frustum culling is on.
+    void SetOcclusionCulling(bool enabled)
+    {
+        m_OcclusionCulling = enabled;
+    }
+
+    // Needs DepthPrepass every frame, and the geometry shader compiled with
+    // DEPTH_PREPASS (see GBuffer.frag)
+    void SetDepthPrepass(bool enabled)
+    {
+        m_DepthPrepass = enabled;
+    }
+
+    // Main must call the matching pass: BlurPass for Gaussian, BloomPass for
+    // MipChain. FinalPass scales the bloom to match.
+    void SetBloomMode(BloomMode mode)
+    {
+        m_BloomMode = mode;
+    }
+
+    // levels is clamped to what fits the window; radius is the upsample
+    // tent's, in texels of the smaller level
+    void SetBloomChain(GLuint levels, float radius)
+    {
+        m_BloomChain.SetLevels(levels);
+        m_BloomChain.SetRadius(radius);
+    }
+
+    // Lets the light boxes draw into target's color while testing against the
+    // G-buffer's own depth, which their shader never samples. Call once.
+    // The full-screen lighting passes skip the background by sampling the
+    // G-buffer (GBufferIsBackground), so target needs no depth of its own.
+    // Only LightingMode::Volumes gives it one: the stencil marking needs a
+    // real depth test, and with the compact layout that depth is blitted in
+    // every frame (see prepareVolumeDepth).
+    void ShareGBufferDepth(Framebuffer& target)
+    {
+        m_LightBoxFBO.shareColorBuffers(target);
+        m_LightBoxFBO.shareDepthBuffer(m_GBuffer);
+    }
+
+    // Renderables are kept by pointer and must outlive the pipeline
+    void PushToGeometryQueue(const Renderable& model)
+    {
+        m_GeometryList.push_back(&model);
+        m_GeometryVisible.push_back(1);
     }
 
     void PushToLightQueue(Light* light)
@@ -62,80 +240,284 @@ public:
         m_LightList.push_back(light);
     }
 
-    void PushToEmissiveQueue(Emissive& model)
+    void PushToEmissiveQueue(const Emissive& model)
+    {
+        m_EmissiveList.push_back(&model);
+        m_EmissiveVisible.push_back(1);
+    }
+
+    void CullPass()
     {
-        m_EmissiveList.push_back(model);
+        ProfileScope scope(m_Profiler, "CullPass");
+
+        // 0. Frustum culling: drop renderables whose bounding sphere is entirely outside the view,
+        // then those behind the depth of the latest Hi-Z readback
+        // ---------------------------------------------------------------------------------------
+        m_Frustum.Extract(m_Projection * m_View);
+        if (m_OcclusionCulling)
+            m_HiZ.Update();
+        size_t occludedGeometry = 0, occludedEmissive = 0;
+        size_t visibleGeometry = cullQueue(m_GeometryList, m_GeometryVisible, occludedGeometry);
+        size_t visibleEmissive = cullQueue(m_EmissiveList, m_EmissiveVisible, occludedEmissive);
+        if (m_Profiler)
+        {
+            m_Profiler->SetCounter("geometry_visible", (double)visibleGeometry);
+            m_Profiler->SetCounter("geometry_culled", (double)(m_GeometryList.size() - visibleGeometry));
+            m_Profiler->SetCounter("emissive_visible", (double)visibleEmissive);
+            m_Profiler->SetCounter("emissive_culled", (double)(m_EmissiveList.size() - visibleEmissive));
+            if (m_OcclusionCulling)
+            {
+                m_Profiler->SetCounter("geometry_occluded", (double)occludedGeometry);
+                m_Profiler->SetCounter("emissive_occluded", (double)occludedEmissive);
+            }
+        }
+
+        // 0.5. Sort what is left into draw order and batch equal models
+        // --------------------------------------------------------------
+        m_RenderQueue.Clear();
+        m_ModelIds.clear();
+        m_MaterialIds.clear();
+        pushToRenderQueue(m_GeometryList, m_GeometryVisible, RenderPass::Geometry);
+        pushToRenderQueue(m_EmissiveList, m_EmissiveVisible, RenderPass::Emissive);
+        m_RenderQueue.Sort();
+        buildBatches();
+        if (m_Profiler)
+            m_Profiler->SetCounter("render_commands", (double)m_RenderQueue.Size());
+
+        // The instance data of every pass goes up at once, in queue order
+        if (!m_Instances.empty())
+            m_InstanceBuffer.setBufferData(m_Instances.size() * sizeof(InstanceData), m_Instances.data(), GL_STREAM_DRAW);
+    }
+
+    // Lays down the G-buffer's depth on its own, so GeometryPass shades each
+    // visible pixel once instead of once per overlapping surface. shader is
+    // the geometry shader compiled with DEPTH_ONLY.
+    void DepthPrepass(Camera& camera, Shader& shader)
+    {
+        if (!m_DepthPrepass)
+            return;
+        ProfileScope scope(m_Profiler, "DepthPrepass");
+
+        // 0.75. Depth pre-pass: only the parallax discard runs, no color is written
+        // --------------------------------------------------------------------------
+        Framebuffer::bind(m_GBuffer.ID);
+        Window::clear(GL_DEPTH_BUFFER_BIT);
+        glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+
+        shader.use();
+        shader.setMat4("projection", m_Projection);
+        shader.setMat4("view", m_View);
+        shader.setVec3("viewPos", camera.Position);
+        drawBatches(RenderPass::Geometry, shader);
+
+        glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
     }
 
     Framebuffer GeometryPass(Window& window, Camera& camera, Shader& shader)
     {
+        ProfileScope scope(m_Profiler, "GeometryPass");
+
         // 1. Geometry Pass: Render scene's geometry/color data into gbuffer
         // -----------------------------------------------------------------
         Framebuffer::bind(m_GBuffer.ID);
-        Window::clear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        if (m_DepthPrepass)
+        {
+            // Depth is final already: only the surface the pre-pass kept passes
+            Window::clear(GL_COLOR_BUFFER_BIT);
+            glDepthFunc(GL_EQUAL);
+            glDepthMask(GL_FALSE);
+        }
+        else
+            Window::clear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
         
         shader.use();
         shader.setMat4("projection", m_Projection);
         shader.setMat4("view", m_View);
         shader.setVec3("viewPos", camera.Position);
+        drawBatches(RenderPass::Geometry, shader);
 
-        for (const auto& g : m_GeometryList)
-            g.Draw(shader);
+        if (m_DepthPrepass)
+        {
+            glDepthFunc(GL_LESS);
+            glDepthMask(GL_TRUE);
+        }
 
         return m_GBuffer;
     }
 
+    // Reduces this frame's G-buffer depth for next frame's CullPass
+    void OcclusionPass(Shader& shader)
+    {
+        if (!m_OcclusionCulling || !m_FrustumCulling)
+            return;
+        ProfileScope scope(m_Profiler, "OcclusionPass");
+
+        // 1.25. Hi-Z: farthest depth per block, read back without waiting
+        // ----------------------------------------------------------------
+        m_HiZ.Build(m_GBufferTextures[0], m_GBufferTextures[1], m_Projection * m_View, shader, m_QuadVAO);
+        Framebuffer::bind(m_DefaultFramebuffer);
+    }
+
     Framebuffer LightingPass(Framebuffer& framebuffer, Camera& camera, Shader& shader)
     {
+        ProfileScope scope(m_Profiler, "LightingPass");
+
         // 2. lighting pass: calculate lighting by iterating over a screen filled quad pixel-by-pixel using the gbuffer's content.
+        // framebuffer needs no depth; the shader discards background pixels itself.
         // -----------------------------------------------------------------------------------------------------------------------
         Framebuffer::bind(framebuffer.ID);
-        Window::clear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        Window::clear(GL_COLOR_BUFFER_BIT);
 
         shader.use();
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, m_GBuffer.colorBuffers[0]);
-        glActiveTexture(GL_TEXTURE1);
-        glBindTexture(GL_TEXTURE_2D, m_GBuffer.colorBuffers[1]);
-        glActiveTexture(GL_TEXTURE2);
-        glBindTexture(GL_TEXTURE_2D, m_GBuffer.colorBuffers[2]);
+        bindGBuffer(shader);
 
-        for (const auto& l : m_LightList)
-            l->SetShaderValues(shader);
+        m_LightBuffer.Update(m_LightList);
+        m_LightBuffer.Bind(3);
+        if (m_Profiler)
+            m_Profiler->SetCounter("light_buffer_bytes", (double)m_LightBuffer.GetUploadedBytes());
 
+        if (m_LightingMode == LightingMode::Clustered)
+        {
+            ProfileScope cullScope(m_Profiler, "LightCulling");
+            m_LightClusters.Build(m_LightList, m_LightBuffer, m_View, m_Projection, m_NearPlane, m_FarPlane);
+            m_LightClusters.Bind(4, 5);
+            m_LightClusters.SetShaderValues(shader);
+            shader.setMat4("view", m_View);
+            if (m_Profiler)
+                m_Profiler->SetCounter("cluster_light_indices", (double)m_LightClusters.GetIndexCount());
+        }
+
+        shader.setInt("lightCount", m_LightBuffer.GetLightCount());
         shader.setVec3("viewPos", camera.Position);
+        glDisable(GL_DEPTH_TEST);
         m_QuadVAO.bind();
         glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
-        glBindVertexArray(0);
+        VertexArray::unbind();
+        glEnable(GL_DEPTH_TEST);
 
         return framebuffer;
     }
 
-    void BlitGBuffer(Framebuffer& target, Window& window)
+    Framebuffer LightVolumePass(Framebuffer& framebuffer, Camera& camera, Shader& stencilShader, Shader& shader)
     {
-        // 2.5. copy content of geometry's depth buffer to target framebuffer's depth buffer
-        // ----------------------------------------------------------------------------------
-        Framebuffer::bindRead(m_GBuffer.ID);
-        Framebuffer::bindDraw(target.ID);
-        Framebuffer::blit(0, 0, window.getWidth(), window.getHeight(), 0, 0, window.getWidth(), window.getHeight(), GL_DEPTH_BUFFER_BIT, GL_NEAREST);
-        Framebuffer::bind(0);
+        ProfileScope scope(m_Profiler, "LightVolumePass");
+
+        // 2. lighting pass (light volumes): shade each light only inside its bounding sphere and add up the results.
+        // framebuffer gets a depth-stencil the first time (see prepareVolumeDepth).
+        // -----------------------------------------------------------------------------------------------------------
+        prepareVolumeDepth(framebuffer);
+        Framebuffer::bind(framebuffer.ID);
+        Window::clear(GL_COLOR_BUFFER_BIT);
+
+        m_LightBuffer.Update(m_LightList);
+        m_LightBuffer.Bind(3);
+
+        stencilShader.use();
+        stencilShader.setMat4("projection", m_Projection);
+        stencilShader.setMat4("view", m_View);
+        shader.use();
+        shader.setMat4("projection", m_Projection);
+        shader.setMat4("view", m_View);
+        shader.setVec3("viewPos", camera.Position);
+        bindGBuffer(shader);
+
+        glDepthMask(GL_FALSE);
+        glBlendEquation(GL_FUNC_ADD);
+        glBlendFunc(GL_ONE, GL_ONE);
+        glEnable(GL_STENCIL_TEST);
+        m_SphereVAO.bind();
+        GLint viewport[4];
+        glGetIntegerv(GL_VIEWPORT, viewport);
+        glm::mat4 viewProjection = m_Projection * m_View;
+        GLuint volumes = 0;
+        for (size_t i = 0; i < m_LightList.size(); i++)
+        {
+            glm::vec3 center;
+            float radius;
+            if (!m_LightList[i]->GetBoundingSphere(center, radius))
+                continue;
+            glm::vec4 sphere(center, radius * m_SphereScale);
+
+            // 2.1. Stencil: back faces behind the surface increment, front faces behind it
+            // decrement, leaving non-zero only where the surface is inside the sphere
+            stencilShader.use();
+            stencilShader.setVec4("lightSphere", sphere);
+            // The sphere only ever touches the stencil inside its screen
+            // rectangle, so only that needs resetting from the last light
+            GLint rect[4];
+            sphereScreenRect(sphere, viewProjection, viewport, rect);
+            glEnable(GL_SCISSOR_TEST);
+            glScissor(rect[0], rect[1], rect[2], rect[3]);
+            glClear(GL_STENCIL_BUFFER_BIT);
+            glDisable(GL_SCISSOR_TEST);
+            glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+            glEnable(GL_DEPTH_TEST);
+            glDisable(GL_CULL_FACE);
+            glDisable(GL_BLEND);
+            glStencilFunc(GL_ALWAYS, 0, 0);
+            glStencilOpSeparate(GL_BACK, GL_KEEP, GL_INCR_WRAP, GL_KEEP);
+            glStencilOpSeparate(GL_FRONT, GL_KEEP, GL_DECR_WRAP, GL_KEEP);
+            glDrawElements(GL_TRIANGLES, m_SphereIndices->getCount(), GL_UNSIGNED_SHORT, 0);
+
+            // 2.2. Shade the marked pixels; back faces so it still works with the camera inside
+            shader.use();
+            shader.setVec4("lightSphere", sphere);
+            shader.setInt("lightOffset", m_LightBuffer.GetOffset(i));
+            glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+            glDisable(GL_DEPTH_TEST);
+            glEnable(GL_CULL_FACE);
+            glCullFace(GL_FRONT);
+            glEnable(GL_BLEND);
+            glStencilFunc(GL_NOTEQUAL, 0, 0xFF);
+            glDrawElements(GL_TRIANGLES, m_SphereIndices->getCount(), GL_UNSIGNED_SHORT, 0);
+            glCullFace(GL_BACK);
+            volumes++;
+        }
+        glDisable(GL_STENCIL_TEST);
+
+        // 2.3. Unbounded (directional) lights cover every non-background pixel
+        glDisable(GL_DEPTH_TEST);
+        glEnable(GL_BLEND);
+        shader.setVec4("lightSphere", glm::vec4(0.0f));
+        m_QuadVAO.bind();
+        for (size_t i = 0; i < m_LightList.size(); i++)
+        {
+            glm::vec3 center;
+            float radius;
+            if (m_LightList[i]->GetBoundingSphere(center, radius))
+                continue;
+            shader.setInt("lightOffset", m_LightBuffer.GetOffset(i));
+            glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+        }
+        glDisable(GL_BLEND);
+        glEnable(GL_DEPTH_TEST);
+        VertexArray::unbind();
+        glDepthMask(GL_TRUE);
+
+        if (m_Profiler)
+            m_Profiler->SetCounter("light_volumes", volumes);
+        return framebuffer;
     }
 
     Framebuffer LightGeometryPass(Framebuffer& framebuffer, Shader& shader)
     {
-        // 3. render lights on top of scene
+        ProfileScope scope(m_Profiler, "LightGeometryPass");
+
+        // 3. render lights on top of scene, into framebuffer's color through
+        // m_LightBoxFBO (see ShareGBufferDepth)
         // --------------------------------
-        Framebuffer::bind(framebuffer.ID);
+        Framebuffer::bind(m_LightBoxFBO.ID);
         shader.use();
         shader.setMat4("projection", m_Projection);
         shader.setMat4("view", m_View);
-        for (const auto& e : m_EmissiveList)
-            e.Draw(shader);
+        drawBatches(RenderPass::Emissive, shader);
         return framebuffer;
     }
 
     Framebuffer BlurPass(Framebuffer& framebuffer, Shader& shader)
     {
+        ProfileScope scope(m_Profiler, "BlurPass");
+
         // 3.5. Blur bright areas
         // ----------------------
         Framebuffer::bind(framebuffer.ID);
@@ -147,33 +529,246 @@ public:
         {
             Framebuffer::bind(m_PingPongFBO[horizontal].ID);
             shader.setInt("horizontal", horizontal);
-            glActiveTexture(GL_TEXTURE0);
-            glBindTexture(GL_TEXTURE_2D, first_iteration ? framebuffer.colorBuffers[1] : m_PingPongFBO[!horizontal].colorBuffers[0]);
+            shader.setBool("extractBright", first_iteration);
+            GLState::BindTexture(0, GL_TEXTURE_2D, first_iteration ? framebuffer.colorBuffers[0] : m_PingPongFBO[!horizontal].colorBuffers[0]);
             glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
             horizontal = !horizontal;
             if (first_iteration)
                 first_iteration = false;
         }
-        glBindVertexArray(0);
+        VertexArray::unbind();
         return m_PingPongFBO[!horizontal];
     }
 
+    // Returns the half resolution bloom texture for FinalPass
+    GLuint BloomPass(Framebuffer& framebuffer, Shader& downsampleShader, Shader& upsampleShader)
+    {
+        ProfileScope scope(m_Profiler, "BloomPass");
+
+        // 3.5. Blur bright areas through a mip chain
+        // -------------------------------------------
+        if (m_Profiler)
+            m_Profiler->SetCounter("bloom_levels", (double)m_BloomChain.GetLevelCount());
+        return m_BloomChain.Render(framebuffer.colorBuffers[0], downsampleShader, upsampleShader, m_QuadVAO);
+    }
+
     void FinalPass(std::vector<GLuint>& textures, Shader& shader)
     {
+        ProfileScope scope(m_Profiler, "FinalPass");
+
         // 4. Perform Postprocessing (HDR, Bloom)
         // --------------------------------------
-        Framebuffer::bind(0);
+        Framebuffer::bind(m_DefaultFramebuffer);
         Window::clear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
         shader.use();
+        shader.setFloat("bloomScale", m_BloomMode == BloomMode::MipChain ? 1.0f / m_BloomChain.GetLevelCount() : 1.0f);
         for (int i = 0; i < textures.size(); i++)
         {
-            glActiveTexture(GL_TEXTURE0+i);
-            glBindTexture(GL_TEXTURE_2D, textures[i]);
+            GLState::BindTexture(i, GL_TEXTURE_2D, textures[i]);
         }
         m_QuadVAO.bind();
         glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
-        glBindVertexArray(0);
+        VertexArray::unbind();
+
+    }
+
+private:
+    // Fills visible for one queue; everything stays visible when culling is off.
+    // occluded counts those that passed the frustum but failed the Hi-Z test.
+    template<typename T>
+    size_t cullQueue(const std::vector<const T*>& queue, std::vector<char>& visible, size_t& occluded)
+    {
+        visible.assign(queue.size(), 1);
+        if (!m_FrustumCulling)
+            return queue.size();
+
+        m_CullSpheres.resize(queue.size());
+        for (size_t i = 0; i < queue.size(); i++)
+        {
+            const Bounds& bounds = queue[i]->model->GetDrawable().bounds;
+            glm::mat4 model = queue[i]->transform.GetModel();
+            // Models without bounds (e.g. failed loads) are never culled
+            float radius = FLT_MAX;
+            if (bounds.isValid())
+            {
+                float scale = std::max(glm::length(glm::vec3(model[0])), std::max(glm::length(glm::vec3(model[1])), glm::length(glm::vec3(model[2]))));
+                radius = bounds.radius * scale;
+            }
+            m_CullSpheres[i] = glm::vec4(glm::vec3(model * glm::vec4(bounds.center, 1.0f)), radius);
+        }
+        size_t visibleCount = m_Frustum.CullSpheres(m_CullSpheres.data(), queue.size(), visible.data());
+        if (m_OcclusionCulling)
+        {
+            size_t unoccluded = m_HiZ.CullSpheres(m_CullSpheres.data(), queue.size(), visible.data());
+            occluded = visibleCount - unoccluded;
+            visibleCount = unoccluded;
+        }
+        return visibleCount;
+    }
+
+    // Adds a command for every visible renderable. The material is the
+    // texture set of the model's first mesh; the depth is its bounding
+    // sphere's centre, so nearer models draw first.
+    template<typename T>
+    void pushToRenderQueue(const std::vector<const T*>& queue, const std::vector<char>& visible, RenderPass pass)
+    {
+        glm::vec4 viewZ(m_View[0][2], m_View[1][2], m_View[2][2], m_View[3][2]);
+        for (size_t i = 0; i < queue.size(); i++)
+        {
+            // Models still streaming in batch with (and draw as) their placeholder
+            const Model& model = queue[i]->model->GetDrawable();
+            if (!visible[i] || model.meshes.empty())
+                continue;
+
+            GLuint modelId = m_ModelIds.emplace(&model, (GLuint)m_ModelIds.size()).first->second;
+            const std::vector<Texture>& textures = model.meshes[0].textures;
+            GLuint texture = textures.empty() ? 0 : textures[0].id;
+            GLuint materialId = m_MaterialIds.emplace(texture, (GLuint)m_MaterialIds.size()).first->second;
+
+            InstanceData instance = queue[i]->GetInstanceData();
+            glm::vec3 center = model.bounds.isValid() ? model.bounds.center : glm::vec3(0.0f);
+            float depth = -glm::dot(viewZ, instance.Model * glm::vec4(center, 1.0f));
+            depth = (depth - m_NearPlane) / (m_FarPlane - m_NearPlane);
+            // Every renderable of a pass shares the pass's program for now
+            m_RenderQueue.Push(RenderQueue::MakeKey(pass, 0, materialId, modelId, depth), &model, instance);
+        }
+    }
+
+    // Cuts the sorted queue into runs of one model and lays the instance
+    // data out in queue order, so every run is one contiguous range
+    void buildBatches()
+    {
+        const std::vector<RenderCommand>& commands = m_RenderQueue.GetCommands();
+        m_Instances.resize(commands.size());
+        m_Batches.clear();
+        GLuint pass = 0;
+        m_PassBatches[0] = 0;
+        for (size_t i = 0; i < commands.size(); i++)
+        {
+            GLuint commandPass = (GLuint)RenderQueue::GetPass(commands[i].key);
+            while (pass < commandPass)
+                m_PassBatches[++pass] = m_Batches.size();
+            m_Instances[i] = m_RenderQueue.GetInstance(commands[i].instance);
+            if (m_Batches.size() == m_PassBatches[pass] || commands[i].model != m_Batches.back().model)
+                m_Batches.push_back({ commands[i].model, (GLuint)i, 0 });
+            m_Batches.back().count++;
+        }
+        while (pass < RENDER_PASSES)
+            m_PassBatches[++pass] = m_Batches.size();
+    }
+
+    void drawBatches(RenderPass pass, Shader& shader)
+    {
+        size_t begin = m_PassBatches[(GLuint)pass], end = m_PassBatches[(GLuint)pass + 1];
+        for (size_t i = begin; i < end; i++)
+        {
+            const InstanceBatch& b = m_Batches[i];
+            b.model->InstancedDraw(shader, b.count, m_InstanceBuffer.getID(), b.first * sizeof(InstanceData));
+        }
+        GeometryArena::Get().Unbind();
+        if (m_Profiler)
+            m_Profiler->SetCounter(pass == RenderPass::Geometry ? "geometry_batches" : "emissive_batches", (double)(end - begin));
+    }
+
+    // Binds the G-buffer where GBuffer.glsl expects it, for the shader in use
+    void bindGBuffer(Shader& shader)
+    {
+        for (GLuint i = 0; i < 3; i++)
+            GLState::BindTexture(i, GL_TEXTURE_2D, m_GBufferTextures[i]);
+        if (m_GBufferLayout == GBufferLayout::Compact)
+            shader.setMat4("inverseViewProjection", glm::inverse(m_Projection * m_View));
+    }
+
+    // The light volumes depth- and stencil-test against the scene. The full
+    // layout's depth is a renderbuffer nothing samples, so target attaches it.
+    // The compact layout's is the texture the volume shader samples, and
+    // sampling a texture attached to the bound framebuffer is a feedback loop
+    // GL leaves undefined, so target gets its own depth-stencil and the depth
+    // is blitted into it every frame. The stencil isn't copied because the
+    // light volumes reset it themselves.
+    void prepareVolumeDepth(Framebuffer& target)
+    {
+        if (target.depthBuffer == 0 && target.depthTexture == 0)
+        {
+            if (m_GBufferLayout == GBufferLayout::Compact)
+                target.attachDepthBuffer(m_Width, m_Height, GL_DEPTH24_STENCIL8);
+            else
+                target.shareDepthBuffer(m_GBuffer);
+        }
+        if (m_GBufferLayout != GBufferLayout::Compact)
+            return;
+        Framebuffer::bindRead(m_GBuffer.ID);
+        Framebuffer::bindDraw(target.ID);
+        Framebuffer::blit(0, 0, m_Width, m_Height, 0, 0, m_Width, m_Height, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+        Framebuffer::bind(m_DefaultFramebuffer);
+    }
+
+    // Pixel rectangle (x, y, width, height) covering the sphere's bounding box
+    // on screen; the whole viewport when the box reaches behind the camera
+    static void sphereScreenRect(const glm::vec4& sphere, const glm::mat4& viewProjection, const GLint viewport[4], GLint rect[4])
+    {
+        glm::vec2 lo(1.0f), hi(-1.0f);
+        for (int corner = 0; corner < 8; corner++)
+        {
+            glm::vec3 offset((corner & 1) ? 1.0f : -1.0f, (corner & 2) ? 1.0f : -1.0f, (corner & 4) ? 1.0f : -1.0f);
+            glm::vec4 clip = viewProjection * glm::vec4(glm::vec3(sphere) + offset * sphere.w, 1.0f);
+            if (clip.w <= 0.0f)
+            {
+                lo = glm::vec2(-1.0f);
+                hi = glm::vec2(1.0f);
+                break;
+            }
+            glm::vec2 ndc = glm::vec2(clip) / clip.w;
+            lo = glm::min(lo, ndc);
+            hi = glm::max(hi, ndc);
+        }
+        lo = glm::clamp(lo, -1.0f, 1.0f);
+        hi = glm::clamp(hi, -1.0f, 1.0f);
+        GLint x0 = viewport[0] + (GLint)std::floor((lo.x * 0.5f + 0.5f) * viewport[2]);
+        GLint y0 = viewport[1] + (GLint)std::floor((lo.y * 0.5f + 0.5f) * viewport[3]);
+        GLint x1 = viewport[0] + (GLint)std::ceil((hi.x * 0.5f + 0.5f) * viewport[2]);
+        GLint y1 = viewport[1] + (GLint)std::ceil((hi.y * 0.5f + 0.5f) * viewport[3]);
+        rect[0] = x0;
+        rect[1] = y0;
+        rect[2] = std::max(x1 - x0, 0);
+        rect[3] = std::max(y1 - y0, 0);
+    }
+
+    void initSphere(GLuint rings, GLuint segments)
+    {
+        const float pi = 3.14159265359f;
+        std::vector<float> vertices;
+        for (GLuint r = 0; r <= rings; r++)
+        {
+            float phi = pi * r / rings;
+            for (GLuint s = 0; s <= segments; s++)
+            {
+                float theta = 2.0f * pi * s / segments;
+                vertices.push_back(std::sin(phi) * std::cos(theta));
+                vertices.push_back(std::cos(phi));
+                vertices.push_back(std::sin(phi) * std::sin(theta));
+            }
+        }
+        std::vector<GLushort> indices;
+        for (GLuint r = 0; r < rings; r++)
+        {
+            for (GLuint s = 0; s < segments; s++)
+            {
+                GLushort i0 = r * (segments + 1) + s;
+                GLushort i1 = i0 + segments + 1;
+                indices.insert(indices.end(), { i0, (GLushort)(i0 + 1), i1 });
+                indices.insert(indices.end(), { (GLushort)(i0 + 1), (GLushort)(i1 + 1), i1 });
+            }
+        }
+        // Push the faces out so the mesh encloses the true sphere
+        m_SphereScale = 1.0f / (std::cos(pi / rings) * std::cos(pi / segments));
 
+        Buffer* sphereBuffer = new Buffer(GL_ARRAY_BUFFER, vertices.size() * sizeof(float), vertices.data());
+        m_SphereVAO.addBuffer(sphereBuffer, 0, 3, 3 * sizeof(float), 0);
+        m_SphereIndices = new IndexBuffer(indices.data(), (GLsizei)indices.size());
+        m_SphereVAO.bind();
+        m_SphereIndices->bind();
+        VertexArray::unbind();
     }
 
 };
\ No newline at end of file
@@ -0,0 +1,122 @@
+#pragma once
+#include <glad/glad.h>
+#include <cstdint>
+#include <cstring>
+#include <utility>
+#include <vector>
+
+#include "../mesh/mesh.h"
+
+class Model;
+
+enum class RenderPass : GLuint
+{
+    Geometry = 0,
+    Emissive = 1
+};
+
+// One instance of a model to draw. Everything the draw order depends on is
+// packed into key, so sorting the commands is sorting 64-bit integers.
+struct RenderCommand
+{
+    uint64_t key;
+    const Model* model;
+    // Index of the instance's data in the queue
+    GLuint instance;
+};
+
+// Per-frame list of draw commands, radix sorted by key. The key orders by,
+// most significant first:
+//   pass (2 bits) | shader (6) | material (16) | model (16) | depth (24)
+// so commands come out grouped by pass and program, then by texture set to
+// keep binds down, then by model so equal models form instanced runs, and
+// front to back within each run for early-Z.
+class RenderQueue
+{
+public:
+    static const GLuint DEPTH_BITS = 24;
+    static const GLuint MODEL_BITS = 16;
+    static const GLuint MATERIAL_BITS = 16;
+    static const GLuint SHADER_BITS = 6;
+private:
+    static const GLuint MODEL_SHIFT = DEPTH_BITS;
+    static const GLuint MATERIAL_SHIFT = MODEL_SHIFT + MODEL_BITS;
+    static const GLuint SHADER_SHIFT = MATERIAL_SHIFT + MATERIAL_BITS;
+    static const GLuint PASS_SHIFT = SHADER_SHIFT + SHADER_BITS;
+
+    std::vector<RenderCommand> m_Commands;
+    std::vector<RenderCommand> m_Scratch;
+    std::vector<InstanceData> m_Instances;
+public:
+    // depth is 0 at the near plane and 1 at the far plane; anything outside
+    // is clamped. Fields wider than their bits wrap, which only costs batching.
+    static uint64_t MakeKey(RenderPass pass, GLuint shader, GLuint material, GLuint model, float depth)
+    {
+        depth = depth < 0.0f ? 0.0f : (depth > 1.0f ? 1.0f : depth);
+        uint64_t quantized = (uint64_t)(depth * (float)((1u << DEPTH_BITS) - 1));
+        return ((uint64_t)pass << PASS_SHIFT)
+            | ((uint64_t)(shader & ((1u << SHADER_BITS) - 1)) << SHADER_SHIFT)
+            | ((uint64_t)(material & ((1u << MATERIAL_BITS) - 1)) << MATERIAL_SHIFT)
+            | ((uint64_t)(model & ((1u << MODEL_BITS) - 1)) << MODEL_SHIFT)
+            | quantized;
+    }
+
+    static RenderPass GetPass(uint64_t key)
+    {
+        return (RenderPass)(key >> PASS_SHIFT);
+    }
+
+    void Clear()
+    {
+        m_Commands.clear();
+        m_Instances.clear();
+    }
+
+    void Push(uint64_t key, const Model* model, const InstanceData& instance)
+    {
+        m_Commands.push_back({ key, model, (GLuint)m_Instances.size() });
+        m_Instances.push_back(instance);
+    }
+
+    // Stable LSD radix sort, a byte per pass. Bytes every key shares (the
+    // unused shader bits, a single material, ...) are skipped.
+    void Sort()
+    {
+        size_t count = m_Commands.size();
+        if (count < 2)
+            return;
+        m_Scratch.resize(count);
+
+        size_t histograms[8][256];
+        std::memset(histograms, 0, sizeof(histograms));
+        for (const RenderCommand& command : m_Commands)
+            for (int b = 0; b < 8; b++)
+                histograms[b][(command.key >> (8 * b)) & 0xFF]++;
+
+        RenderCommand* src = m_Commands.data();
+        RenderCommand* dst = m_Scratch.data();
+        for (int b = 0; b < 8; b++)
+        {
+            size_t* histogram = histograms[b];
+            if (histogram[(src[0].key >> (8 * b)) & 0xFF] == count)
+                continue;
+
+            size_t offset = 0;
+            for (int i = 0; i < 256; i++)
+            {
+                size_t n = histogram[i];
+                histogram[i] = offset;
+                offset += n;
+            }
+            for (size_t i = 0; i < count; i++)
+                dst[histogram[(src[i].key >> (8 * b)) & 0xFF]++] = src[i];
+            std::swap(src, dst);
+        }
+        if (src != m_Commands.data())
+            m_Commands.swap(m_Scratch);
+    }
+
+    inline const std::vector<RenderCommand>& GetCommands() const { return m_Commands; }
+    inline const InstanceData& GetInstance(GLuint instance) const { return m_Instances[instance]; }
+    inline size_t Size() const { return m_Commands.size(); }
+};
@@ -6,14 +6,12 @@ class Emissive : public Renderable
 {
 public:
     Light* light;
-    Emissive(Model& model, Light* light, Transform transform)
+    Emissive(const ModelHandle& model, Light* light, Transform transform)
         :  Renderable(model, transform), light(light) {
     }
 
-    virtual void Draw(Shader& shader) const override
+    virtual InstanceData GetInstanceData() const override
     {
-        shader.setMat4("model", transform.GetModel());
-        shader.setVec3("color", light->color);
-        model.Draw(shader);
+        return { transform.GetModel(), glm::vec4(light->color, 1.0f), transform.GetNormalMatrix() };
     }
 };
\ No newline at end of file
@@ -1,19 +1,19 @@
 #pragma once
-#include <glm\ext\matrix_transform.hpp>
-#include "../model/model.h"
+#include <glm/ext/matrix_transform.hpp>
+#include "../model/modelregistry.h"
 #include "Transform.h"
 
 class Renderable
 {
 public:
     Transform transform;
-    Model model;
-    Renderable(Model& model, Transform transform)
+    ModelHandle model;
+    Renderable(const ModelHandle& model, Transform transform)
         : model(model), transform(transform) {}
 
-    virtual void Draw(Shader& shader) const
+    // Per-instance attributes the pipeline batches into one instanced draw per model
+    virtual InstanceData GetInstanceData() const
     {
-        shader.setMat4("model", transform.GetModel());
-        model.Draw(shader);
+        return { transform.GetModel(), glm::vec4(1.0f), transform.GetNormalMatrix() };
     }
 };
\ No newline at end of file
@@ -1,31 +1,50 @@
 #pragma once
-#include <glm\ext\matrix_transform.hpp>
+#include <glm/glm.hpp>
+#include "scenegraph.h"
+
+// A renderable's node in a SceneGraph. The setters replace the node's local
+// position, rotation and scale; the matrices follow on the graph's next
+// Update(). The graph must outlive every Transform that refers to it.
 struct Transform
 {
 private:
-    glm::mat4 m_Model;
+    SceneGraph* m_Graph;
+    GLuint m_Node;
 public:
-    Transform(glm::mat4& model) : m_Model(model) {}
-    glm::mat4 GetModel() const
+    Transform(SceneGraph& graph, GLuint node) : m_Graph(&graph), m_Node(node) {}
+    const glm::mat4& GetModel() const
+    {
+        return m_Graph->GetWorld(m_Node);
+    }
+    const glm::mat3& GetNormalMatrix() const
     {
-        return m_Model;
+        return m_Graph->GetNormalMatrix(m_Node);
     }
     glm::vec3 GetPosition() const
     {
-        return glm::vec3(m_Model[3][0], m_Model[3][1], m_Model[3][2]);
+        return m_Graph->GetPosition(m_Node);
     }
     glm::vec3 GetScale() const
     {
-        return glm::vec3(m_Model[0][0], m_Model[1][1], m_Model[2][2]);
+        return m_Graph->GetScale(m_Node);
+    }
+    GLuint GetNode() const
+    {
+        return m_Node;
     }
 
     void SetPosition(glm::vec3 position)
     {
-        m_Model = glm::translate(m_Model, position);
+        m_Graph->SetPosition(m_Node, position);
+    }
+
+    void SetRotation(glm::quat rotation)
+    {
+        m_Graph->SetRotation(m_Node, rotation);
     }
 
     void SetScale(glm::vec3 scale)
     {
-        m_Model = glm::scale(m_Model, scale);
+        m_Graph->SetScale(m_Node, scale);
     }
 };
\ No newline at end of file
@@ -0,0 +1,179 @@
+#include "scenegraph.h"
+
+#include <iostream>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define SCENEGRAPH_SSE 1
+#endif
+
+GLuint SceneGraph::CreateNode(const glm::vec3& position, GLuint parent)
+{
+    GLuint node = (GLuint)m_Parents.size();
+    if (parent != NO_PARENT && parent >= node)
+    {
+#ifdef _DEBUG
+        std::cout << "SceneGraph: parent " << parent << " does not exist, node " << node << " made a root" << std::endl;
+#endif
+        parent = NO_PARENT;
+    }
+    m_Positions.push_back(position);
+    m_Rotations.push_back(glm::quat(1.0f, 0.0f, 0.0f, 0.0f));
+    m_Scales.push_back(glm::vec3(1.0f));
+    m_Parents.push_back(parent);
+    m_Dirty.push_back(1);
+    m_World.push_back(glm::mat4(1.0f));
+    m_Normal.push_back(glm::mat3(1.0f));
+    return node;
+}
+
+void SceneGraph::SetPosition(GLuint node, const glm::vec3& position)
+{
+    m_Positions[node] = position;
+    m_Dirty[node] = 1;
+}
+
+void SceneGraph::SetRotation(GLuint node, const glm::quat& rotation)
+{
+    m_Rotations[node] = rotation;
+    m_Dirty[node] = 1;
+}
+
+void SceneGraph::SetScale(GLuint node, const glm::vec3& scale)
+{
+    m_Scales[node] = scale;
+    m_Dirty[node] = 1;
+}
+
+size_t SceneGraph::Update()
+{
+    // 1. World matrices, parents first. Dirty flags are only cleared at the
+    // end, so a dirty parent marks each of its children on the way down.
+    // ---------------------------------------------------------------------
+    m_Updated.clear();
+    GLuint count = (GLuint)m_Parents.size();
+    for (GLuint i = 0; i < count; i++)
+    {
+        GLuint parent = m_Parents[i];
+        if (parent != NO_PARENT && m_Dirty[parent])
+            m_Dirty[i] = 1;
+        if (!m_Dirty[i])
+            continue;
+        updateWorld(i);
+        m_Updated.push_back(i);
+    }
+
+    // 2. Normal matrices only depend on their own world matrix
+    // --------------------------------------------------------
+    updateNormalMatrices(0, m_Updated.size());
+    for (GLuint node : m_Updated)
+        m_Dirty[node] = 0;
+    return m_Updated.size();
+}
+
+// world = parent * T * R * S. The local matrix is never built: its columns
+// are the rotation's scaled by s and the translation, so each world column
+// is a combination of the parent's.
+void SceneGraph::updateWorld(GLuint node)
+{
+    glm::mat3 rotation = glm::mat3_cast(m_Rotations[node]);
+    const glm::vec3& s = m_Scales[node];
+    const glm::vec3& t = m_Positions[node];
+    glm::mat4& world = m_World[node];
+
+    GLuint parent = m_Parents[node];
+    if (parent == NO_PARENT)
+    {
+        for (int c = 0; c < 3; c++)
+            world[c] = glm::vec4(rotation[c] * s[c], 0.0f);
+        world[3] = glm::vec4(t, 1.0f);
+        return;
+    }
+
+    const glm::mat4& p = m_World[parent];
+#ifdef SCENEGRAPH_SSE
+    __m128 p0 = _mm_loadu_ps(&p[0][0]);
+    __m128 p1 = _mm_loadu_ps(&p[1][0]);
+    __m128 p2 = _mm_loadu_ps(&p[2][0]);
+    __m128 p3 = _mm_loadu_ps(&p[3][0]);
+    for (int c = 0; c < 3; c++)
+    {
+        __m128 column = _mm_add_ps(_mm_add_ps(
+            _mm_mul_ps(p0, _mm_set1_ps(rotation[c][0])),
+            _mm_mul_ps(p1, _mm_set1_ps(rotation[c][1]))),
+            _mm_mul_ps(p2, _mm_set1_ps(rotation[c][2])));
+        _mm_storeu_ps(&world[c][0], _mm_mul_ps(column, _mm_set1_ps(s[c])));
+    }
+    __m128 translation = _mm_add_ps(_mm_add_ps(
+        _mm_mul_ps(p0, _mm_set1_ps(t.x)),
+        _mm_mul_ps(p1, _mm_set1_ps(t.y))),
+        _mm_add_ps(_mm_mul_ps(p2, _mm_set1_ps(t.z)), p3));
+    _mm_storeu_ps(&world[3][0], translation);
+#else
+    for (int c = 0; c < 3; c++)
+        world[c] = (p[0] * rotation[c][0] + p[1] * rotation[c][1] + p[2] * rotation[c][2]) * s[c];
+    world[3] = p[0] * t.x + p[1] * t.y + p[2] * t.z + p[3];
+#endif
+}
+
+// The inverse transpose of a 3x3 with columns a, b, c has columns
+// (b x c, c x a, a x b) / det. Four nodes at a time, one SIMD lane each.
+void SceneGraph::updateNormalMatrices(size_t begin, size_t end)
+{
+    size_t i = begin;
+#ifdef SCENEGRAPH_SSE
+    for (; i + 4 <= end; i += 4)
+    {
+        const GLuint* nodes = &m_Updated[i];
+        // m[c][r]: row r of column c, across the four nodes
+        __m128 m[3][4];
+        for (int c = 0; c < 3; c++)
+        {
+            m[c][0] = _mm_loadu_ps(&m_World[nodes[0]][c][0]);
+            m[c][1] = _mm_loadu_ps(&m_World[nodes[1]][c][0]);
+            m[c][2] = _mm_loadu_ps(&m_World[nodes[2]][c][0]);
+            m[c][3] = _mm_loadu_ps(&m_World[nodes[3]][c][0]);
+            _MM_TRANSPOSE4_PS(m[c][0], m[c][1], m[c][2], m[c][3]);
+        }
+
+        __m128 n[3][4];
+        for (int c = 0; c < 3; c++)
+        {
+            const __m128* a = m[(c + 1) % 3];
+            const __m128* b = m[(c + 2) % 3];
+            n[c][0] = _mm_sub_ps(_mm_mul_ps(a[1], b[2]), _mm_mul_ps(a[2], b[1]));
+            n[c][1] = _mm_sub_ps(_mm_mul_ps(a[2], b[0]), _mm_mul_ps(a[0], b[2]));
+            n[c][2] = _mm_sub_ps(_mm_mul_ps(a[0], b[1]), _mm_mul_ps(a[1], b[0]));
+            n[c][3] = _mm_setzero_ps();
+        }
+        __m128 det = _mm_add_ps(_mm_add_ps(
+            _mm_mul_ps(m[0][0], n[0][0]),
+            _mm_mul_ps(m[0][1], n[0][1])),
+            _mm_mul_ps(m[0][2], n[0][2]));
+        // Degenerate (zero scale) nodes get a zero matrix rather than infinities
+        __m128 invDet = _mm_and_ps(_mm_div_ps(_mm_set1_ps(1.0f), det), _mm_cmpneq_ps(det, _mm_setzero_ps()));
+
+        for (int c = 0; c < 3; c++)
+        {
+            n[c][0] = _mm_mul_ps(n[c][0], invDet);
+            n[c][1] = _mm_mul_ps(n[c][1], invDet);
+            n[c][2] = _mm_mul_ps(n[c][2], invDet);
+            _MM_TRANSPOSE4_PS(n[c][0], n[c][1], n[c][2], n[c][3]);
+            for (int k = 0; k < 4; k++)
+            {
+                float column[4];
+                _mm_storeu_ps(column, n[c][k]);
+                m_Normal[nodes[k]][c] = glm::vec3(column[0], column[1], column[2]);
+            }
+        }
+    }
+#endif
+    for (; i < end; i++)
+    {
+        const glm::mat4& world = m_World[m_Updated[i]];
+        glm::vec3 a(world[0]), b(world[1]), c(world[2]);
+        glm::mat3 cofactors(glm::cross(b, c), glm::cross(c, a), glm::cross(a, b));
+        float det = glm::dot(a, cofactors[0]);
+        m_Normal[m_Updated[i]] = det != 0.0f ? cofactors * (1.0f / det) : glm::mat3(0.0f);
+    }
+}
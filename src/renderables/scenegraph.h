@@ -0,0 +1,54 @@
+#pragma once
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <vector>
+
+// Transform hierarchy stored as parallel arrays, one entry per node.
+//
+// Setters only replace a node's local position/rotation/scale and mark it
+// dirty; Update() then recomputes the world and normal matrices of dirty
+// nodes and everything below them, and leaves the rest alone. A node's
+// parent always comes before it in the arrays, so a single pass in index
+// order sees every parent finished before its children.
+class SceneGraph
+{
+public:
+    static const GLuint NO_PARENT = ~0u;
+private:
+    // Local TRS
+    std::vector<glm::vec3> m_Positions;
+    std::vector<glm::quat> m_Rotations;
+    std::vector<glm::vec3> m_Scales;
+    std::vector<GLuint> m_Parents;
+    std::vector<char> m_Dirty;
+    // Results of the last Update()
+    std::vector<glm::mat4> m_World;
+    // Inverse transpose of the world matrix's upper 3x3, for normals
+    std::vector<glm::mat3> m_Normal;
+    // Nodes recomputed by the last Update()
+    std::vector<GLuint> m_Updated;
+public:
+    // parent must already exist; the node starts at position with no
+    // rotation and unit scale
+    GLuint CreateNode(const glm::vec3& position = glm::vec3(0.0f), GLuint parent = NO_PARENT);
+
+    void SetPosition(GLuint node, const glm::vec3& position);
+    void SetRotation(GLuint node, const glm::quat& rotation);
+    void SetScale(GLuint node, const glm::vec3& scale);
+
+    inline const glm::vec3& GetPosition(GLuint node) const { return m_Positions[node]; }
+    inline const glm::quat& GetRotation(GLuint node) const { return m_Rotations[node]; }
+    inline const glm::vec3& GetScale(GLuint node) const { return m_Scales[node]; }
+    inline GLuint GetParent(GLuint node) const { return m_Parents[node]; }
+    inline const glm::mat4& GetWorld(GLuint node) const { return m_World[node]; }
+    inline const glm::mat3& GetNormalMatrix(GLuint node) const { return m_Normal[node]; }
+    inline size_t GetNodeCount() const { return m_Parents.size(); }
+
+    // Returns how many nodes were recomputed
+    size_t Update();
+private:
+    void updateWorld(GLuint node);
+    // Normal matrices of m_Updated[begin, end)
+    void updateNormalMatrices(size_t begin, size_t end);
+};
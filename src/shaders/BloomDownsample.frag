@@ -0,0 +1,43 @@
+#version 330 core
+out vec4 FragColor;
+
+in vec2 TexCoords;
+
+uniform sampler2D image;
+// First level reads the lit scene and keeps only the parts brighter than 1.0
+uniform bool extractBright;
+
+vec3 Sample(vec2 uv)
+{
+  vec3 color = texture(image, uv).rgb;
+  if (extractBright)
+    color *= float(dot(color, vec3(0.2126, 0.7152, 0.0722)) > 1.0);
+  return color;
+}
+
+// 13 bilinear taps, each averaging a 2x2 texel block: five overlapping 4x4
+// boxes, the centre one weighted 0.5 and the four corner ones 0.125 each.
+// Rendered at half the image's size, so TexCoords sits between four texels.
+void main()
+{
+  vec2 texel = 1.0 / textureSize(image, 0);
+  vec3 a = Sample(TexCoords + texel * vec2(-2.0,  2.0));
+  vec3 b = Sample(TexCoords + texel * vec2( 0.0,  2.0));
+  vec3 c = Sample(TexCoords + texel * vec2( 2.0,  2.0));
+  vec3 d = Sample(TexCoords + texel * vec2(-2.0,  0.0));
+  vec3 e = Sample(TexCoords);
+  vec3 f = Sample(TexCoords + texel * vec2( 2.0,  0.0));
+  vec3 g = Sample(TexCoords + texel * vec2(-2.0, -2.0));
+  vec3 h = Sample(TexCoords + texel * vec2( 0.0, -2.0));
+  vec3 i = Sample(TexCoords + texel * vec2( 2.0, -2.0));
+  vec3 j = Sample(TexCoords + texel * vec2(-1.0,  1.0));
+  vec3 k = Sample(TexCoords + texel * vec2( 1.0,  1.0));
+  vec3 l = Sample(TexCoords + texel * vec2(-1.0, -1.0));
+  vec3 m = Sample(TexCoords + texel * vec2( 1.0, -1.0));
+
+  vec3 result = e * 0.125;
+  result += (a + c + g + i) * 0.03125;
+  result += (b + d + f + h) * 0.0625;
+  result += (j + k + l + m) * 0.125;
+  FragColor = vec4(result, 1.0);
+}
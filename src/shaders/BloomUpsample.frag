@@ -0,0 +1,21 @@
+#version 330 core
+out vec4 FragColor;
+
+in vec2 TexCoords;
+
+// The smaller level; the output is added onto the level above it
+uniform sampler2D image;
+// Tent radius in texels of image
+uniform float radius;
+
+// 3x3 tent: 1 2 1 / 2 4 2 / 1 2 1, over 16
+void main()
+{
+  vec2 d = radius / vec2(textureSize(image, 0));
+  vec3 result = texture(image, TexCoords).rgb * 4.0;
+  result += (texture(image, TexCoords + vec2(-d.x, 0.0)).rgb + texture(image, TexCoords + vec2(d.x, 0.0)).rgb) * 2.0;
+  result += (texture(image, TexCoords + vec2(0.0, -d.y)).rgb + texture(image, TexCoords + vec2(0.0, d.y)).rgb) * 2.0;
+  result += texture(image, TexCoords + vec2(-d.x, -d.y)).rgb + texture(image, TexCoords + vec2(d.x, -d.y)).rgb;
+  result += texture(image, TexCoords + vec2(-d.x, d.y)).rgb + texture(image, TexCoords + vec2(d.x, d.y)).rgb;
+  FragColor = vec4(result / 16.0, 1.0);
+}
@@ -5,26 +5,36 @@ in vec2 TexCoords;
 
 uniform sampler2D image;
 uniform bool horizontal;
+// First pass reads the lit scene and keeps only the parts brighter than 1.0
+uniform bool extractBright;
 uniform float weight[5] = float[] (0.227027, 0.1945946, 0.1216216, 0.054054, 0.016216);
 
+vec3 Sample(vec2 uv)
+{
+  vec3 color = texture(image, uv).rgb;
+  if (extractBright)
+    color *= float(dot(color, vec3(0.2126, 0.7152, 0.0722)) > 1.0);
+  return color;
+}
+
 void main()
 {
   vec2 tex_offset = 1.0 / textureSize(image, 0);
-  vec3 result = texture(image, TexCoords).rgb * weight[0];
+  vec3 result = Sample(TexCoords) * weight[0];
   if (horizontal)
   {
     for (int i = 1; i < 5; i++)
     {
-      result += texture(image, TexCoords + vec2(tex_offset.x * i, 0.0)).rgb * weight[i];
-      result += texture(image, TexCoords - vec2(tex_offset.x * i, 0.0)).rgb * weight[i];
+      result += Sample(TexCoords + vec2(tex_offset.x * i, 0.0)) * weight[i];
+      result += Sample(TexCoords - vec2(tex_offset.x * i, 0.0)) * weight[i];
     }
   }
   else
   {
     for (int i = 1; i < 5; i++)
     {
-      result += texture(image, TexCoords + vec2(0.0, tex_offset.y * i)).rgb * weight[i];
-      result += texture(image, TexCoords - vec2(0.0, tex_offset.y * i)).rgb * weight[i];
+      result += Sample(TexCoords + vec2(0.0, tex_offset.y * i)) * weight[i];
+      result += Sample(TexCoords - vec2(0.0, tex_offset.y * i)) * weight[i];
     }
   }
   FragColor = vec4(result, 1.0);
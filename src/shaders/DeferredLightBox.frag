@@ -1,12 +1,9 @@
 #version 330 core
 layout (location = 0) out vec4 FragColor;
-layout (location = 1) out vec4 BrightColor;
 
-uniform vec3 color;
+flat in vec3 Color;
 
 void main()
 {
-  FragColor = vec4(color, 1.0);
-  float brightness = dot(FragColor.rgb, vec3(0.2126, 0.7152, 0.0722));
-  BrightColor = vec4(FragColor.rgb * float(brightness > 1.0), 1.0);
+  FragColor = vec4(Color, 1.0);
 }
\ No newline at end of file
@@ -1,11 +1,15 @@
 #version 330 core
 layout (location = 0) in vec3 aPos;
+layout (location = 5) in mat4 aModel;
+layout (location = 9) in vec4 aColor;
+
+flat out vec3 Color;
 
 uniform mat4 projection;
 uniform mat4 view;
-uniform mat4 model;
 
 void main()
 {
-  gl_Position = projection * view * model * vec4(aPos, 1.0);
+  Color = aColor.rgb;
+  gl_Position = projection * view * aModel * vec4(DecodePosition(aPos), 1.0);
 }
\ No newline at end of file
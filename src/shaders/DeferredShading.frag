@@ -1,54 +1,52 @@
 #version 330 core
 layout (location = 0) out vec4 FragColor;
-layout (location = 1) out vec4 BrightColor;
 
 in vec2 TexCoords;
 
-uniform sampler2D gPosition;
-uniform sampler2D gNormal;
-uniform sampler2D gAlbedoSpec;
-
-struct PointLight {
-  vec3 Position;
-  vec3 Ambient;
-  vec3 Color;
-  samplerCube ShadowMap;
-  float Linear;
-  float Quadratic;
-};
-
-const int POINT_LIGHTS = 16;
-uniform PointLight pointLight[POINT_LIGHTS];
+// The G-buffer samplers come from GBuffer.glsl, CalcLight and the light
+// record layout from Lighting.glsl
+uniform int lightCount;
 uniform vec3 viewPos;
 
+#ifdef CLUSTERED
+// See LightClusters: per-cluster (offset, count) into a list of record offsets
+const ivec3 CLUSTER_SIZE = ivec3(16, 9, 24);
+uniform usamplerBuffer clusterGrid;
+uniform usamplerBuffer clusterLights;
+uniform int globalLightCount;
+uniform vec2 clusterDepth;
+uniform mat4 view;
+#endif
+
 void main()
 {
-  vec3 FragPos = texture(gPosition, TexCoords).rgb;
-  vec3 Normal = texture(gNormal, TexCoords).rgb;
+  if (GBufferIsBackground(TexCoords))
+    discard;
+  vec3 FragPos = GBufferPosition(TexCoords);
+  vec3 Normal = GBufferNormal(TexCoords);
   vec3 Diffuse = texture(gAlbedoSpec, TexCoords).rgb;
   float Specular = texture(gAlbedoSpec, TexCoords).a;
 
   vec3 lighting = vec3(0);
   vec3 viewDir = normalize(viewPos - FragPos);
-  for (int i = 0; i < POINT_LIGHTS; i++)
+#ifdef CLUSTERED
+  for (int i = 0; i < globalLightCount; i++)
+    lighting += CalcLight(int(texelFetch(clusterLights, i).r), FragPos, Normal, viewDir, Diffuse, Specular);
+
+  float depth = max(-(view * vec4(FragPos, 1.0)).z, 1e-4);
+  ivec2 tile = ivec2(gl_FragCoord.xy / vec2(textureSize(gAlbedoSpec, 0)) * vec2(CLUSTER_SIZE.xy));
+  int slice = clamp(int(log(depth) * clusterDepth.x + clusterDepth.y), 0, CLUSTER_SIZE.z - 1);
+  uvec2 cluster = texelFetch(clusterGrid, tile.x + CLUSTER_SIZE.x * (tile.y + CLUSTER_SIZE.y * slice)).rg;
+  for (uint i = 0u; i < cluster.y; i++)
+    lighting += CalcLight(int(texelFetch(clusterLights, int(cluster.x + i)).r), FragPos, Normal, viewDir, Diffuse, Specular);
+#else
+  int offset = 0;
+  for (int i = 0; i < lightCount; i++)
   {
-    // ambient
-    vec3 ambient = pointLight[i].Ambient * Diffuse;
-    // diffuse
-    vec3 lightVector = pointLight[i].Position - FragPos;
-    vec3 lightDir = normalize(lightVector);
-    vec3 diffuse = Diffuse * max(dot(Normal, lightDir), 0.0);
-    // specular
-    vec3 halfwayDir = normalize(lightDir + viewDir);
-    float specular = Specular * pow(max(dot(Normal, halfwayDir), 0.0), 64.0);
-    // attenuation
-    float distance = dot(lightVector, lightVector);
-    float attenuation = 1.0 / distance;
-
-    lighting += attenuation * (ambient + (diffuse + specular) * pointLight[i].Color);
+    lighting += CalcLight(offset, FragPos, Normal, viewDir, Diffuse, Specular);
+    offset += int(texelFetch(lights, offset).w) == LIGHT_SPOT ? 5 : 3;
   }
+#endif
 
   FragColor = vec4(lighting, 1.0);
-  float brightness = dot(FragColor.rgb, vec3(0.2126, 0.7152, 0.0722));
-  BrightColor = vec4(FragColor.rgb * float(brightness > 1.0), 1.0);
-}
\ No newline at end of file
+}
@@ -1,11 +1,24 @@
 #version 330 core
-layout (location = 0) out vec3 gPosition;
-layout (location = 1) out vec3 gNormal;
-layout (location = 2) out vec4 gAlbedoSpec;
+// Layout and normal encoding come from GBuffer.glsl
+//
+// With a depth pre-pass (Pipeline::DepthPrepass) this is compiled twice:
+// DEPTH_ONLY for the pre-pass, which writes no color and only has to decide
+// which fragments are discarded, and DEPTH_PREPASS for the G-buffer pass
+// itself, which then never discards so the driver can test depth early.
+#if defined(DEPTH_ONLY)
+#elif defined(COMPACT_GBUFFER)
+layout (location = 0) out vec2 outNormal;
+layout (location = 1) out vec4 outAlbedoSpec;
+#else
+layout (location = 0) out vec3 outPosition;
+layout (location = 1) out vec3 outNormal;
+layout (location = 2) out vec4 outAlbedoSpec;
+#endif
 
 in vec2 TexCoords;
 in vec3 FragPos;
 in vec3 Normal;
+in vec4 Tangent;
 
 struct Material {
   sampler2D texture_diffuse1;
@@ -22,20 +35,12 @@ uniform float minLayers;
 uniform float maxLayers;
 uniform float heightScale;
 
-mat3 cotangent_frame(vec3 N, vec3 p, vec2 uv)
+// The per-vertex tangent, re-orthogonalised against the interpolated normal
+mat3 tangent_frame(vec3 N, vec4 tangent)
 {
-  vec3 dp1 = dFdx(p);
-  vec3 dp2 = dFdy(p);
-  vec2 duv1 = dFdx(uv);
-  vec2 duv2 = dFdy(uv);
-
-  vec3 dp2perp = cross(dp2, N);
-  vec3 dp1perp = cross(N, dp1);
-  vec3 T = dp2perp * duv1.x + dp1perp * duv2.x;
-  vec3 B = dp2perp * duv1.y + dp1perp * duv2.y;
-
-  float invmax = inversesqrt(max(dot(T, T), dot(B, B)));
-  return mat3(T * invmax, B * invmax, N);
+  vec3 T = normalize(tangent.xyz - N * dot(N, tangent.xyz));
+  vec3 B = cross(N, T) * tangent.w;
+  return mat3(T, B, N);
 }
 
 vec2 parallax_mapping(vec2 texCoords, vec3 V_TBN)
@@ -69,24 +74,39 @@ vec2 parallax_mapping(vec2 texCoords, vec3 V_TBN)
 
 vec3 perturb_normal(vec2 texCoords, mat3 TBN)
 {
-  vec3 map = texture(material.texture_normal1, texCoords).xyz;
-  return normalize(TBN * normalize(map * 2.0 - 1.0));
+  // Only xy is stored (BC5 normal maps have no blue channel), z is rebuilt
+  vec2 xy = texture(material.texture_normal1, texCoords).xy * 2.0 - 1.0;
+  vec3 map = vec3(xy, sqrt(max(1.0 - dot(xy, xy), 0.0)));
+  return normalize(TBN * map);
 }
 
 void main()
 {
-  gPosition = FragPos;
-
-  vec3 viewDir = normalize(viewPos - FragPos);
-  mat3 TBN = cotangent_frame(normalize(Normal), -viewDir, TexCoords);
+  mat3 TBN = tangent_frame(normalize(Normal), Tangent);
   mat3 TBN_T = transpose(TBN);
   vec3 viewDirTBN = normalize((TBN_T * viewPos) - (TBN_T * FragPos));
 
+#ifdef DEPTH_ONLY
+  // parallax_mapping moves the coordinates by at most the full offset plus
+  // one layer, so fragments farther than that from the texture's edges can
+  // never be discarded and skip the height map
+  vec2 reach = abs(viewDirTBN.xy / viewDirTBN.z * heightScale) * (1.0 + 1.0 / minLayers);
+  if (all(greaterThanEqual(TexCoords, reach)) && all(lessThanEqual(TexCoords, 1.0 - reach)))
+    return;
+#endif
+
   vec2 texCoords = parallax_mapping(TexCoords, viewDirTBN);
+#ifndef DEPTH_PREPASS
   if (texCoords.x > 1.0 || texCoords.y > 1.0 || texCoords.x < 0.0 || texCoords.y < 0.0)
     discard;
-
-  gNormal = perturb_normal(texCoords, TBN);
-  gAlbedoSpec.rgb = texture(material.texture_diffuse1, texCoords).rgb;
-  gAlbedoSpec.a = texture(material.texture_specular1, texCoords).r;
+#endif
+
+#ifndef DEPTH_ONLY
+#ifndef COMPACT_GBUFFER
+  outPosition = FragPos;
+#endif
+  outNormal = EncodeGBufferNormal(perturb_normal(texCoords, TBN));
+  outAlbedoSpec.rgb = texture(material.texture_diffuse1, texCoords).rgb;
+  outAlbedoSpec.a = texture(material.texture_specular1, texCoords).r;
+#endif
 }
\ No newline at end of file
@@ -0,0 +1,78 @@
+// G-buffer layout, injected after #version into every shader that writes or
+// reads it. The samplers are on units 0-2 (see Pipeline::bindGBuffer); the
+// writer's outputs are named out* so they don't clash with them.
+//
+// Full (RGBA16F everywhere):
+//   gPosition    world position
+//   gNormal      world normal
+//   gAlbedoSpec  albedo rgb, specular a
+// Compact (COMPACT_GBUFFER defined):
+//   gDepth       the depth attachment; position is rebuilt with
+//                inverseViewProjection
+//   gNormal      RG16, octahedral world normal
+//   gAlbedoSpec  RGBA8, albedo rgb, specular a
+#ifdef COMPACT_GBUFFER
+uniform sampler2D gDepth;
+uniform mat4 inverseViewProjection;
+#else
+uniform sampler2D gPosition;
+#endif
+uniform sampler2D gNormal;
+uniform sampler2D gAlbedoSpec;
+
+vec2 OctahedralWrap(vec2 v)
+{
+  return (1.0 - abs(v.yx)) * vec2(v.x < 0.0 ? -1.0 : 1.0, v.y < 0.0 ? -1.0 : 1.0);
+}
+
+// What GBuffer.frag writes for the normal
+#ifdef COMPACT_GBUFFER
+vec2 EncodeGBufferNormal(vec3 n)
+{
+  n /= abs(n.x) + abs(n.y) + abs(n.z);
+  vec2 e = n.z < 0.0 ? OctahedralWrap(n.xy) : n.xy;
+  return e * 0.5 + 0.5;
+}
+#else
+vec3 EncodeGBufferNormal(vec3 n)
+{
+  return n;
+}
+#endif
+
+vec3 GBufferNormal(vec2 uv)
+{
+#ifdef COMPACT_GBUFFER
+  vec2 e = texture(gNormal, uv).xy * 2.0 - 1.0;
+  vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+  if (n.z < 0.0)
+    n.xy = OctahedralWrap(n.xy);
+  return normalize(n);
+#else
+  return texture(gNormal, uv).rgb;
+#endif
+}
+
+// True where the geometry pass drew nothing: the depth is still at the far
+// plane, or with the full layout the normal is still cleared to zero. Lets
+// full-screen passes skip the background without a depth attachment.
+bool GBufferIsBackground(vec2 uv)
+{
+#ifdef COMPACT_GBUFFER
+  return texture(gDepth, uv).r == 1.0;
+#else
+  vec3 n = texture(gNormal, uv).rgb;
+  return dot(n, n) == 0.0;
+#endif
+}
+
+vec3 GBufferPosition(vec2 uv)
+{
+#ifdef COMPACT_GBUFFER
+  vec4 ndc = vec4(uv, texture(gDepth, uv).r, 1.0) * 2.0 - 1.0;
+  vec4 world = inverseViewProjection * ndc;
+  return world.xyz / world.w;
+#else
+  return texture(gPosition, uv).rgb;
+#endif
+}
@@ -1,22 +1,31 @@
 #version 330 core
 layout (location = 0) in vec3 aPos;
-layout (location = 1) in vec3 aNormal;
+layout (location = 1) in vec4 aNormal;
 layout (location = 2) in vec2 aTexCoords;
+layout (location = 3) in vec4 aTangent;
+layout (location = 5) in mat4 aModel;
+layout (location = 10) in mat3 aNormalMatrix;
 
 out vec3 FragPos;
 out vec3 Normal;
 out vec2 TexCoords;
+out vec4 Tangent;
 
-uniform mat4 model;
 uniform mat4 view;
 uniform mat4 projection;
 
+// The depth pre-pass and the G-buffer pass are separate programs that must
+// agree on depth exactly for the GL_EQUAL test
+invariant gl_Position;
+
 void main()
 {
-  vec4 worldPos = model * vec4(aPos, 1.0);
+  vec4 worldPos = aModel * vec4(DecodePosition(aPos), 1.0);
   FragPos = worldPos.xyz;
   TexCoords = aTexCoords;
-  Normal = transpose(inverse(mat3(model))) * aNormal;
+  Normal = aNormalMatrix * DecodeOctahedral(aNormal.xy);
+  vec4 tangent = DecodeTangent(aTangent);
+  Tangent = vec4(mat3(aModel) * tangent.xyz, tangent.w);
 
   gl_Position = projection * view * worldPos;
 }
\ No newline at end of file
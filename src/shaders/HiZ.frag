@@ -0,0 +1,37 @@
+#version 330 core
+layout (location = 0) out float Depth;
+
+// The G-buffer samplers come from GBuffer.glsl
+uniform mat4 viewProjection;
+
+// G-buffer texels per Hi-Z texel, see HiZBuffer::REDUCTION
+const int REDUCTION = 4;
+
+// Farthest window-space depth of the block; background (cleared depth, or no
+// normal written) is the far plane, so nothing is ever culled behind it
+void main()
+{
+  ivec2 size = textureSize(gNormal, 0);
+  ivec2 origin = ivec2(gl_FragCoord.xy) * REDUCTION;
+  float farthest = 0.0;
+  for (int y = 0; y < REDUCTION; y++)
+  {
+    for (int x = 0; x < REDUCTION; x++)
+    {
+      ivec2 texel = min(origin + ivec2(x, y), size - 1);
+#ifdef COMPACT_GBUFFER
+      float depth = texelFetch(gDepth, texel, 0).r;
+#else
+      vec3 normal = texelFetch(gNormal, texel, 0).rgb;
+      float depth = 1.0;
+      if (dot(normal, normal) > 0.0)
+      {
+        vec4 clip = viewProjection * vec4(texelFetch(gPosition, texel, 0).rgb, 1.0);
+        depth = clip.z / clip.w * 0.5 + 0.5;
+      }
+#endif
+      farthest = max(farthest, depth);
+    }
+  }
+  Depth = farthest;
+}
@@ -0,0 +1,22 @@
+#version 330 core
+layout (location = 0) out vec4 FragColor;
+
+// The G-buffer samplers come from GBuffer.glsl, CalcLight and the light
+// record layout from Lighting.glsl
+uniform int lightOffset;
+uniform vec3 viewPos;
+
+void main()
+{
+  vec2 TexCoords = gl_FragCoord.xy / vec2(textureSize(gAlbedoSpec, 0));
+  if (GBufferIsBackground(TexCoords))
+    discard;
+  vec3 FragPos = GBufferPosition(TexCoords);
+  vec3 Normal = GBufferNormal(TexCoords);
+  vec3 Diffuse = texture(gAlbedoSpec, TexCoords).rgb;
+  float Specular = texture(gAlbedoSpec, TexCoords).a;
+
+  vec3 viewDir = normalize(viewPos - FragPos);
+  // Blended additively; alpha stays at the cleared 1.0
+  FragColor = vec4(CalcLight(lightOffset, FragPos, Normal, viewDir, Diffuse, Specular), 0.0);
+}
@@ -0,0 +1,16 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+
+uniform mat4 projection;
+uniform mat4 view;
+// xyz = centre, w = radius of the bounding sphere. A radius of 0 means an
+// unbounded light, drawn with the fullscreen quad instead of the sphere.
+uniform vec4 lightSphere;
+
+void main()
+{
+  if (lightSphere.w > 0.0)
+    gl_Position = projection * view * vec4(aPos * lightSphere.w + lightSphere.xyz, 1.0);
+  else
+    gl_Position = vec4(aPos, 1.0);
+}
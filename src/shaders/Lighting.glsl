@@ -0,0 +1,58 @@
+// Shared light evaluation, injected after #version by Shader::createShader.
+//
+// Packed light records, see Light::Pack. The first texel's w is the type.
+//   point:       [position, type] [color, radius] [ambient, -]
+//   spot:        [position, type] [color, radius] [ambient, -] [direction, cosCutOff] [k1, k2, k3, cosOuterCutOff]
+//   directional: [direction, type] [color, -] [ambient, -]
+const int LIGHT_POINT = 0;
+const int LIGHT_SPOT = 1;
+const int LIGHT_DIRECTIONAL = 2;
+
+uniform samplerBuffer lights;
+
+vec3 CalcLight(int offset, vec3 FragPos, vec3 Normal, vec3 viewDir, vec3 Diffuse, float Specular)
+{
+  vec4 header = texelFetch(lights, offset);
+  vec4 color = texelFetch(lights, offset + 1);
+  vec3 ambientColor = texelFetch(lights, offset + 2).rgb;
+  int type = int(header.w);
+
+  vec3 lightDir;
+  float attenuation;
+  if (type == LIGHT_DIRECTIONAL)
+  {
+    lightDir = -header.xyz;
+    attenuation = 1.0;
+  }
+  else
+  {
+    vec3 lightVector = header.xyz - FragPos;
+    float distance = dot(lightVector, lightVector);
+    // Beyond the radius the light is below the cutoff it was culled with
+    if (distance > color.w * color.w)
+      return vec3(0.0);
+    lightDir = normalize(lightVector);
+    if (type == LIGHT_SPOT)
+    {
+      vec4 cone = texelFetch(lights, offset + 3);
+      vec4 k = texelFetch(lights, offset + 4);
+      float theta = dot(lightDir, -cone.xyz);
+      float intensity = clamp((theta - k.w) / (cone.w - k.w), 0.0, 1.0);
+      attenuation = intensity / (k.x + k.y * sqrt(distance) + k.z * distance);
+    }
+    else
+    {
+      attenuation = 1.0 / distance;
+    }
+  }
+
+  // ambient
+  vec3 ambient = ambientColor * Diffuse;
+  // diffuse
+  vec3 diffuse = Diffuse * max(dot(Normal, lightDir), 0.0);
+  // specular
+  vec3 halfwayDir = normalize(lightDir + viewDir);
+  float specular = Specular * pow(max(dot(Normal, halfwayDir), 0.0), 64.0);
+
+  return attenuation * (ambient + (diffuse + specular) * color.rgb);
+}
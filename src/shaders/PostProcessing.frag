@@ -6,14 +6,107 @@ in vec2 TexCoords;
 uniform sampler2D scene_color;
 uniform sampler2D scene_bloom;
 uniform float exposure;
+// The mip-chain bloom adds up every level; this brings it back to the
+// Gaussian's brightness (see Pipeline::FinalPass)
+uniform float bloomScale = 1.0;
+// 0 to 1, with SHARPEN
+uniform float sharpness = 0.5;
 
-void main()
+// FXAA or SHARPEN, when defined, filter the tonemapped image in this same
+// pass. They call Resolve() again for the neighbouring texels instead of
+// reading back a tonemapped target, so no extra full-screen pass is needed.
+
+// Bloom composite, tonemap and gamma of one scene texel
+vec3 Resolve(ivec2 texel)
 {
   const float gamma = 2.2;
-  vec3 color = texture(scene_color, TexCoords).rgb;
-  vec3 bloom = texture(scene_bloom, TexCoords).rgb;
+  ivec2 size = textureSize(scene_color, 0);
+  texel = clamp(texel, ivec2(0), size - 1);
+  vec3 color = texelFetch(scene_color, texel, 0).rgb;
+  vec3 bloom = texture(scene_bloom, (vec2(texel) + 0.5) / vec2(size)).rgb * bloomScale;
   vec3 result = color + bloom;
   result = vec3(1.0) - exp(-result * exposure);
-  result = pow(result, vec3(1.0 / gamma));
-  FragColor = vec4(result, 1.0);
-}
\ No newline at end of file
+  return pow(result, vec3(1.0 / gamma));
+}
+
+float Luma(vec3 color)
+{
+  return dot(color, vec3(0.299, 0.587, 0.114));
+}
+
+#ifdef FXAA
+const float FXAA_EDGE_THRESHOLD = 0.125;
+const float FXAA_EDGE_THRESHOLD_MIN = 0.0312;
+const float FXAA_REDUCE_MUL = 1.0 / 8.0;
+const float FXAA_REDUCE_MIN = 1.0 / 128.0;
+const float FXAA_SPAN_MAX = 8.0;
+
+// What a bilinear fetch of the tonemapped image would return; pos is in texels
+vec3 ResolveBilinear(vec2 pos)
+{
+  pos -= 0.5;
+  ivec2 base = ivec2(floor(pos));
+  vec2 f = pos - floor(pos);
+  vec3 bottom = mix(Resolve(base), Resolve(base + ivec2(1, 0)), f.x);
+  vec3 top = mix(Resolve(base + ivec2(0, 1)), Resolve(base + ivec2(1, 1)), f.x);
+  return mix(bottom, top, f.y);
+}
+
+// Lottes' FXAA: blur along the edge direction estimated from the luma of
+// the diagonal neighbours. Flat areas leave after the first five texels.
+vec3 Fxaa(ivec2 texel)
+{
+  vec3 rgbM = Resolve(texel);
+  float lumaM = Luma(rgbM);
+  float lumaNW = Luma(Resolve(texel + ivec2(-1, 1)));
+  float lumaNE = Luma(Resolve(texel + ivec2(1, 1)));
+  float lumaSW = Luma(Resolve(texel + ivec2(-1, -1)));
+  float lumaSE = Luma(Resolve(texel + ivec2(1, -1)));
+  float lumaMin = min(lumaM, min(min(lumaNW, lumaNE), min(lumaSW, lumaSE)));
+  float lumaMax = max(lumaM, max(max(lumaNW, lumaNE), max(lumaSW, lumaSE)));
+  if (lumaMax - lumaMin < max(FXAA_EDGE_THRESHOLD_MIN, lumaMax * FXAA_EDGE_THRESHOLD))
+    return rgbM;
+
+  vec2 dir = vec2(-((lumaNW + lumaNE) - (lumaSW + lumaSE)), (lumaNW + lumaSW) - (lumaNE + lumaSE));
+  float dirReduce = max((lumaNW + lumaNE + lumaSW + lumaSE) * 0.25 * FXAA_REDUCE_MUL, FXAA_REDUCE_MIN);
+  float rcpDirMin = 1.0 / (min(abs(dir.x), abs(dir.y)) + dirReduce);
+  dir = clamp(dir * rcpDirMin, vec2(-FXAA_SPAN_MAX), vec2(FXAA_SPAN_MAX));
+
+  vec2 centre = vec2(texel) + 0.5;
+  vec3 rgbA = 0.5 * (ResolveBilinear(centre + dir * (1.0 / 3.0 - 0.5)) + ResolveBilinear(centre + dir * (2.0 / 3.0 - 0.5)));
+  vec3 rgbB = rgbA * 0.5 + 0.25 * (ResolveBilinear(centre - dir * 0.5) + ResolveBilinear(centre + dir * 0.5));
+  float lumaB = Luma(rgbB);
+  return (lumaB < lumaMin || lumaB > lumaMax) ? rgbA : rgbB;
+}
+#endif
+
+#ifdef SHARPEN
+// Contrast-adaptive sharpening over the 4 direct neighbours: the less room
+// the neighbourhood leaves before clipping, the weaker the kernel, so edges
+// that are already hard don't ring
+vec3 Sharpen(ivec2 texel)
+{
+  vec3 c = Resolve(texel);
+  vec3 n = Resolve(texel + ivec2(0, 1));
+  vec3 s = Resolve(texel + ivec2(0, -1));
+  vec3 e = Resolve(texel + ivec2(1, 0));
+  vec3 w = Resolve(texel + ivec2(-1, 0));
+  vec3 minimum = min(c, min(min(n, s), min(e, w)));
+  vec3 maximum = max(c, max(max(n, s), max(e, w)));
+  vec3 amount = sqrt(clamp(min(minimum, 1.0 - maximum) / max(maximum, vec3(1e-5)), 0.0, 1.0));
+  vec3 weight = -amount / mix(8.0, 5.0, sharpness);
+  return clamp((c + (n + s + e + w) * weight) / (1.0 + 4.0 * weight), 0.0, 1.0);
+}
+#endif
+
+void main()
+{
+  ivec2 texel = ivec2(TexCoords * vec2(textureSize(scene_color, 0)));
+#if defined(FXAA)
+  FragColor = vec4(Fxaa(texel), 1.0);
+#elif defined(SHARPEN)
+  FragColor = vec4(Sharpen(texel), 1.0);
+#else
+  FragColor = vec4(Resolve(texel), 1.0);
+#endif
+}
@@ -0,0 +1,27 @@
+// PackedVertex decode, injected after #version by Shader::createShader.
+//
+//   location 0  position  unorm16 in the mesh's box -> DecodePosition
+//   location 1  normal    octahedral xy, snorm 10:10 -> DecodeOctahedral
+//   location 2  texcoords half floats, read as is
+//   location 3  tangent   octahedral xy, snorm 10:10, w = bitangent sign
+uniform vec3 positionScale;
+uniform vec3 positionBias;
+
+vec3 DecodePosition(vec3 p)
+{
+  return p * positionScale + positionBias;
+}
+
+vec3 DecodeOctahedral(vec2 e)
+{
+  vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+  if (n.z < 0.0)
+    n.xy = (1.0 - abs(n.yx)) * vec2(n.x < 0.0 ? -1.0 : 1.0, n.y < 0.0 ? -1.0 : 1.0);
+  return normalize(n);
+}
+
+// Tangent in xyz, the bitangent's sign in w (B = cross(N, T) * w)
+vec4 DecodeTangent(vec4 t)
+{
+  return vec4(DecodeOctahedral(t.xy), t.w < 0.0 ? -1.0 : 1.0);
+}
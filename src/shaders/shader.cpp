@@ -1,5 +1,7 @@
 #include <iostream>
 #include <string>
+#include <cstring>
+#include <stdexcept>
 #include <glm/gtc/type_ptr.hpp>
 
 #include "shader.h"
@@ -26,19 +28,36 @@ Shader::Shader(const GLsizei shaderCount, const GLuint* shaderIDs)
         std::cout << "ERROR::SHADER::LINKING\n" << infoLog << std::endl;
     }
 #endif
+
+    reflect();
 }
 
 Shader::~Shader()
 {
-    glDeleteProgram(ID);
+    GLState::DeleteProgram(ID);
 }
 
 GLuint Shader::createShader(const char* path, GLenum shaderType, std::vector<const char*> preprocessor)
 {
     GLuint shaderID = glCreateShader(shaderType);
     std::string shaderCode = read_file(path);
-    preprocessor.push_back(shaderCode.c_str());
-    glShaderSource(shaderID, preprocessor.size(), &preprocessor[0], NULL);
+    // #version has to stay the first line, so the extra chunks (defines,
+    // shared code) go right after it and #line restores the file's numbering.
+    // The newline in front keeps a chunk without a final one from swallowing it.
+    std::string version;
+    size_t body = 0;
+    if (shaderCode.compare(0, 8, "#version") == 0)
+    {
+        body = shaderCode.find('\n');
+        body = body == std::string::npos ? shaderCode.size() : body + 1;
+        version = shaderCode.substr(0, body);
+    }
+    std::vector<const char*> sources;
+    sources.push_back(version.c_str());
+    sources.insert(sources.end(), preprocessor.begin(), preprocessor.end());
+    sources.push_back(body > 0 ? "\n#line 2\n" : "\n#line 1\n");
+    sources.push_back(shaderCode.c_str() + body);
+    glShaderSource(shaderID, (GLsizei)sources.size(), sources.data(), NULL);
     glCompileShader(shaderID);
 
 #if _DEBUG
@@ -57,7 +76,7 @@ GLuint Shader::createShader(const char* path, GLenum shaderType, std::vector<con
 
 void Shader::use() const
 {
-    glUseProgram(ID);
+    GLState::UseProgram(ID);
 }
 
 void Shader::bindUniformBlock(const char* name, GLuint index) const
@@ -66,34 +85,156 @@ void Shader::bindUniformBlock(const char* name, GLuint index) const
     glUniformBlockBinding(ID, uniformBlockIndex, index);
 }
 
-void Shader::setBool(const char* name, bool value) const
+// Resolve every active uniform once so the setters never touch strings.
+// Arrays are registered per element ("weight[3]"), and their base name is an
+// alias of element 0, the same way glGetUniformLocation treats it. Both
+// names lead to the same entry, so they share one shadow copy.
+void Shader::reflect()
+{
+    GLint count = 0, maxLength = 0;
+    glGetProgramiv(ID, GL_ACTIVE_UNIFORMS, &count);
+    glGetProgramiv(ID, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+    std::vector<char> buffer(maxLength > 0 ? maxLength : 1);
+
+    for (GLint i = 0; i < count; i++)
+    {
+        GLsizei length = 0;
+        GLint size = 0;
+        GLenum type;
+        glGetActiveUniform(ID, (GLuint)i, (GLsizei)buffer.size(), &length, &size, &type, buffer.data());
+        std::string name(buffer.data(), length);
+
+        size_t bracket = name.size() > 3 ? name.size() - 3 : std::string::npos;
+        if (bracket != std::string::npos && name.compare(bracket, 3, "[0]") == 0)
+        {
+            std::string base = name.substr(0, bracket);
+            GLint first = (GLint)m_Uniforms.size();
+            for (GLint e = 0; e < size; e++)
+            {
+                std::string element = base + "[" + std::to_string(e) + "]";
+                addUniform(element, glGetUniformLocation(ID, element.c_str()));
+            }
+            if (first < (GLint)m_Uniforms.size())
+                addLookup(base, first);
+        }
+        else
+        {
+            addUniform(name, glGetUniformLocation(ID, name.c_str()));
+        }
+    }
+}
+
+void Shader::addUniform(const std::string& name, GLint location)
+{
+    // Uniform block members have no location; they are set through buffers
+    if (location < 0)
+        return;
+    Uniform uniform;
+    uniform.name = name;
+    uniform.location = location;
+    uniform.cached = false;
+    m_Uniforms.push_back(uniform);
+    addLookup(name, (GLint)m_Uniforms.size() - 1);
+}
+
+// Setters only ever see the hash, so two names sharing one would silently
+// write each other's uniform; refuse the program instead, in every build
+void Shader::addLookup(const std::string& name, GLint index)
+{
+    auto inserted = m_Lookup.emplace(UniformName::Hash(name.c_str()), index);
+    if (!inserted.second)
+        throw std::runtime_error("ERROR::SHADER::UNIFORM_HASH_COLLISION: " + name + " and " + m_Uniforms[inserted.first->second].name);
+}
+
+UniformHandle Shader::getUniform(UniformName name) const
+{
+    UniformHandle handle;
+    auto it = m_Lookup.find(name.hash);
+    if (it != m_Lookup.end())
+        handle.index = it->second;
+    return handle;
+}
+
+// Compares against the shadow copy and records the new value. The caller
+// uploads only when this returns true.
+bool Shader::shouldUpload(UniformHandle uniform, const void* value, size_t size) const
+{
+    if (!uniform.isValid())
+        return false;
+    Uniform& cached = m_Uniforms[uniform.index];
+    if (cached.cached && std::memcmp(cached.value, value, size) == 0)
+    {
+        m_Stats.skipped++;
+        return false;
+    }
+    std::memcpy(cached.value, value, size);
+    cached.cached = true;
+    m_Stats.uploads++;
+    return true;
+}
+
+void Shader::setBool(UniformName name, bool value) const
+{
+    setBool(getUniform(name), value);
+}
+void Shader::setInt(UniformName name, int value) const
+{
+    setInt(getUniform(name), value);
+}
+void Shader::setFloat(UniformName name, float value) const
+{
+    setFloat(getUniform(name), value);
+}
+void Shader::setVec4(UniformName name, const glm::vec4& value) const
 {
-    glUniform1i(glGetUniformLocation(ID, name), (int)value);
+    setVec4(getUniform(name), value);
 }
-void Shader::setInt(const char* name, int value) const
+void Shader::setVec3(UniformName name, const glm::vec3& value) const
 {
-    glUniform1i(glGetUniformLocation(ID, name), value);
+    setVec3(getUniform(name), value);
 }
-void Shader::setFloat(const char* name, float value) const
+void Shader::setVec2(UniformName name, const glm::vec2& value) const
 {
-    glUniform1f(glGetUniformLocation(ID, name), value);
+    setVec2(getUniform(name), value);
+}
+void Shader::setMat4(UniformName name, const glm::mat4& value) const
+{
+    setMat4(getUniform(name), value);
+}
+
+void Shader::setBool(UniformHandle uniform, bool value) const
+{
+    setInt(uniform, (int)value);
+}
+void Shader::setInt(UniformHandle uniform, int value) const
+{
+    if (shouldUpload(uniform, &value, sizeof(value)))
+        glUniform1i(m_Uniforms[uniform.index].location, value);
+}
+void Shader::setFloat(UniformHandle uniform, float value) const
+{
+    if (shouldUpload(uniform, &value, sizeof(value)))
+        glUniform1f(m_Uniforms[uniform.index].location, value);
 }
 
-void Shader::setVec4(const char* name, const glm::vec4& value) const
+void Shader::setVec4(UniformHandle uniform, const glm::vec4& value) const
 {
-    glUniform4f(glGetUniformLocation(ID, name), value.x, value.y, value.z, value.w);
+    if (shouldUpload(uniform, glm::value_ptr(value), sizeof(value)))
+        glUniform4f(m_Uniforms[uniform.index].location, value.x, value.y, value.z, value.w);
 }
 
-void Shader::setVec3(const char* name, const glm::vec3& value) const
+void Shader::setVec3(UniformHandle uniform, const glm::vec3& value) const
 {
-    glUniform3f(glGetUniformLocation(ID, name), value.x, value.y, value.z);
+    if (shouldUpload(uniform, glm::value_ptr(value), sizeof(value)))
+        glUniform3f(m_Uniforms[uniform.index].location, value.x, value.y, value.z);
 }
-void Shader::setVec2(const char* name, const glm::vec2& value) const
+void Shader::setVec2(UniformHandle uniform, const glm::vec2& value) const
 {
-    glUniform2f(glGetUniformLocation(ID, name), value.x, value.y);
+    if (shouldUpload(uniform, glm::value_ptr(value), sizeof(value)))
+        glUniform2f(m_Uniforms[uniform.index].location, value.x, value.y);
 }
-void Shader::setMat4(const char* name, const glm::mat4& value) const
+void Shader::setMat4(UniformHandle uniform, const glm::mat4& value) const
 {
-    GLint location = glGetUniformLocation(ID, name);
-    glUniformMatrix4fv(location, 1, GL_FALSE, glm::value_ptr(value));
-}
\ No newline at end of file
+    if (shouldUpload(uniform, glm::value_ptr(value), sizeof(value)))
+        glUniformMatrix4fv(m_Uniforms[uniform.index].location, 1, GL_FALSE, glm::value_ptr(value));
+}
@@ -3,22 +3,89 @@
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
 #include <glm/glm.hpp>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
 #include <vector>
 
+// FNV-1a hash of a uniform name. The const char* constructor is consteval,
+// so a string literal is always hashed by the compiler and never per call;
+// names only known at runtime have to come in as std::string.
+struct UniformName
+{
+    uint32_t hash;
+    consteval UniformName(const char* name) : hash(Hash(name)) {}
+    UniformName(const std::string& name) : hash(Hash(name.c_str())) {}
+
+    static constexpr uint32_t Hash(const char* name)
+    {
+        uint32_t hash = 2166136261u;
+        while (*name)
+        {
+            hash ^= (uint8_t)*name++;
+            hash *= 16777619u;
+        }
+        return hash;
+    }
+};
+
+// Index of a uniform resolved at link time; -1 if the program doesn't use it
+struct UniformHandle
+{
+    GLint index = -1;
+    inline bool isValid() const { return index >= 0; }
+};
+
+struct UniformStats
+{
+    GLuint uploads = 0;
+    GLuint skipped = 0;
+};
+
 class Shader
 {
     const GLuint ID;
+private:
+    struct Uniform
+    {
+        std::string name;
+        GLint location;
+        bool cached;
+        // Shadow copy of the last uploaded value, large enough for a mat4
+        unsigned char value[sizeof(glm::mat4)];
+    };
+    mutable std::vector<Uniform> m_Uniforms;
+    std::unordered_map<uint32_t, GLint> m_Lookup;
+    mutable UniformStats m_Stats;
 public:
     Shader(const GLsizei shaderCount, const GLuint* shaderIDs);
     ~Shader();
     static GLuint createShader(const char* path, GLenum shaderType, std::vector<const char*> preprocessor = {});
     void use() const;
     void bindUniformBlock(const char* name, GLuint index) const;
-    void setBool(const char* name, bool value) const;
-    void setInt(const char* name, int value) const;
-    void setFloat(const char* name, float value) const;
-    void setVec4(const char* name, const glm::vec4& value) const;
-    void setVec3(const char* name, const glm::vec3& value) const;
-    void setVec2(const char* name, const glm::vec2& value) const;
-    void setMat4(const char* name, const glm::mat4& value) const;
-};
\ No newline at end of file
+
+    UniformHandle getUniform(UniformName name) const;
+    inline const UniformStats& getUniformStats() const { return m_Stats; }
+    inline void resetUniformStats() const { m_Stats = UniformStats(); }
+
+    void setBool(UniformName name, bool value) const;
+    void setInt(UniformName name, int value) const;
+    void setFloat(UniformName name, float value) const;
+    void setVec4(UniformName name, const glm::vec4& value) const;
+    void setVec3(UniformName name, const glm::vec3& value) const;
+    void setVec2(UniformName name, const glm::vec2& value) const;
+    void setMat4(UniformName name, const glm::mat4& value) const;
+
+    void setBool(UniformHandle uniform, bool value) const;
+    void setInt(UniformHandle uniform, int value) const;
+    void setFloat(UniformHandle uniform, float value) const;
+    void setVec4(UniformHandle uniform, const glm::vec4& value) const;
+    void setVec3(UniformHandle uniform, const glm::vec3& value) const;
+    void setVec2(UniformHandle uniform, const glm::vec2& value) const;
+    void setMat4(UniformHandle uniform, const glm::mat4& value) const;
+private:
+    void reflect();
+    void addUniform(const std::string& name, GLint location);
+    void addLookup(const std::string& name, GLint index);
+    bool shouldUpload(UniformHandle uniform, const void* value, size_t size) const;
+};
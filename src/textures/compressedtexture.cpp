@@ -0,0 +1,628 @@
+#include "compressedtexture.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <thread>
+#include "../utils/glstate.h"
+#include "../utils/mappedfile.h"
+#include "../utils/stb_image.h"
+
+namespace
+{
+    struct DDSPixelFormat
+    {
+        uint32_t size;
+        uint32_t flags;
+        uint32_t fourCC;
+        uint32_t rgbBitCount;
+        uint32_t masks[4];
+    };
+
+    struct DDSHeader
+    {
+        uint32_t size;
+        uint32_t flags;
+        uint32_t height;
+        uint32_t width;
+        uint32_t pitchOrLinearSize;
+        uint32_t depth;
+        uint32_t mipMapCount;
+        uint32_t reserved1[11];
+        DDSPixelFormat pixelFormat;
+        uint32_t caps[4];
+        uint32_t reserved2;
+    };
+
+    struct DDSHeaderDX10
+    {
+        uint32_t dxgiFormat;
+        uint32_t resourceDimension;
+        uint32_t miscFlag;
+        uint32_t arraySize;
+        uint32_t miscFlags2;
+    };
+
+    constexpr uint32_t makeFourCC(char a, char b, char c, char d)
+    {
+        return (uint32_t)(unsigned char)a | (uint32_t)(unsigned char)b << 8 | (uint32_t)(unsigned char)c << 16 | (uint32_t)(unsigned char)d << 24;
+    }
+
+    const uint32_t DDS_MAGIC = makeFourCC('D', 'D', 'S', ' ');
+    const uint32_t DDSD_CAPS = 0x1, DDSD_HEIGHT = 0x2, DDSD_WIDTH = 0x4, DDSD_PIXELFORMAT = 0x1000;
+    const uint32_t DDSD_MIPMAPCOUNT = 0x20000, DDSD_LINEARSIZE = 0x80000;
+    const uint32_t DDPF_FOURCC = 0x4;
+    const uint32_t DDSCAPS_COMPLEX = 0x8, DDSCAPS_TEXTURE = 0x1000, DDSCAPS_MIPMAP = 0x400000;
+    const uint32_t DX10_TEXTURE2D = 3;
+
+    struct FormatInfo
+    {
+        GLenum format;
+        uint32_t dxgiFormat;
+        const char* suffix;
+        size_t blockSize;
+    };
+
+    const FormatInfo FORMATS[] = {
+        { GL_COMPRESSED_RGB_S3TC_DXT1_EXT, 71, "bc1", 8 },
+        { GL_COMPRESSED_SRGB_S3TC_DXT1_EXT, 72, "bc1s", 8 },
+        { GL_COMPRESSED_RGBA_S3TC_DXT5_EXT, 77, "bc3", 16 },
+        { GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT, 78, "bc3s", 16 },
+        { GL_COMPRESSED_RED_RGTC1, 80, "bc4", 8 },
+        { GL_COMPRESSED_RG_RGTC2, 83, "bc5", 16 },
+    };
+
+    const FormatInfo* findFormat(GLenum format)
+    {
+        for (const auto& f : FORMATS)
+        {
+            if (f.format == format)
+                return &f;
+        }
+        return NULL;
+    }
+
+    const FormatInfo* findDXGIFormat(uint32_t dxgiFormat)
+    {
+        for (const auto& f : FORMATS)
+        {
+            if (f.dxgiFormat == dxgiFormat)
+                return &f;
+        }
+        return NULL;
+    }
+
+    const FormatInfo* findFourCC(uint32_t fourCC)
+    {
+        if (fourCC == makeFourCC('D', 'X', 'T', '1'))
+            return findFormat(GL_COMPRESSED_RGB_S3TC_DXT1_EXT);
+        if (fourCC == makeFourCC('D', 'X', 'T', '5'))
+            return findFormat(GL_COMPRESSED_RGBA_S3TC_DXT5_EXT);
+        if (fourCC == makeFourCC('A', 'T', 'I', '1') || fourCC == makeFourCC('B', 'C', '4', 'U'))
+            return findFormat(GL_COMPRESSED_RED_RGTC1);
+        if (fourCC == makeFourCC('A', 'T', 'I', '2') || fourCC == makeFourCC('B', 'C', '5', 'U'))
+            return findFormat(GL_COMPRESSED_RG_RGTC2);
+        return NULL;
+    }
+
+    bool isSRGB(GLenum format)
+    {
+        return format == GL_COMPRESSED_SRGB_S3TC_DXT1_EXT || format == GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT;
+    }
+
+    GLenum toSRGB(GLenum format)
+    {
+        if (format == GL_COMPRESSED_RGB_S3TC_DXT1_EXT)
+            return GL_COMPRESSED_SRGB_S3TC_DXT1_EXT;
+        if (format == GL_COMPRESSED_RGBA_S3TC_DXT5_EXT)
+            return GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT;
+        return format;
+    }
+
+    // Set by DetectSupport on the context thread before any loader thread reads them
+    bool s3tcSupported = false;
+    bool s3tcSRGBSupported = false;
+
+    uint16_t packRGB565(const float* c)
+    {
+        int r = std::min(std::max((int)std::lround(c[0] * 31.0f / 255.0f), 0), 31);
+        int g = std::min(std::max((int)std::lround(c[1] * 63.0f / 255.0f), 0), 63);
+        int b = std::min(std::max((int)std::lround(c[2] * 31.0f / 255.0f), 0), 31);
+        return (uint16_t)(r << 11 | g << 5 | b);
+    }
+
+    void unpackRGB565(uint16_t c, float* out)
+    {
+        int r = (c >> 11) & 31, g = (c >> 5) & 63, b = c & 31;
+        out[0] = (float)(r << 3 | r >> 2);
+        out[1] = (float)(g << 2 | g >> 4);
+        out[2] = (float)(b << 3 | b >> 2);
+    }
+
+    // One channel of a 4x4 RGBA block as BC4: two endpoints and a 3-bit
+    // index per pixel, always in the 8-value mode (first endpoint larger)
+    void encodeBC4(const unsigned char* block, int channel, unsigned char* out)
+    {
+        int lo = 255, hi = 0;
+        for (int i = 0; i < 16; i++)
+        {
+            lo = std::min(lo, (int)block[i * 4 + channel]);
+            hi = std::max(hi, (int)block[i * 4 + channel]);
+        }
+        out[0] = (unsigned char)hi;
+        out[1] = (unsigned char)lo;
+
+        uint64_t bits = 0;
+        if (hi > lo)
+        {
+            for (int i = 0; i < 16; i++)
+            {
+                // Step k of 7 from lo to hi; code 0 is hi, 1 is lo, 2..7 run from hi down
+                int k = (int)std::lround((block[i * 4 + channel] - lo) * 7.0f / (hi - lo));
+                uint64_t code = k == 7 ? 0 : k == 0 ? 1 : 8 - k;
+                bits |= code << (3 * i);
+            }
+        }
+        for (int i = 0; i < 6; i++)
+            out[2 + i] = (unsigned char)(bits >> (8 * i));
+    }
+
+    // RGB of a 4x4 RGBA block as BC1 in the four-colour mode. The endpoints
+    // span the block's colours along their principal axis, inset by 1/16 so a
+    // single outlier doesn't stretch the palette.
+    void encodeBC1(const unsigned char* block, unsigned char* out)
+    {
+        float mean[3] = { 0.0f, 0.0f, 0.0f };
+        for (int i = 0; i < 16; i++)
+            for (int c = 0; c < 3; c++)
+                mean[c] += block[i * 4 + c] / 16.0f;
+
+        float cov[6] = { 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f };
+        for (int i = 0; i < 16; i++)
+        {
+            float r = block[i * 4] - mean[0], g = block[i * 4 + 1] - mean[1], b = block[i * 4 + 2] - mean[2];
+            cov[0] += r * r; cov[1] += r * g; cov[2] += r * b;
+            cov[3] += g * g; cov[4] += g * b; cov[5] += b * b;
+        }
+        float axis[3] = { 1.0f, 1.0f, 1.0f };
+        for (int iteration = 0; iteration < 8; iteration++)
+        {
+            float x = cov[0] * axis[0] + cov[1] * axis[1] + cov[2] * axis[2];
+            float y = cov[1] * axis[0] + cov[3] * axis[1] + cov[4] * axis[2];
+            float z = cov[2] * axis[0] + cov[4] * axis[1] + cov[5] * axis[2];
+            float length = std::max(std::max(std::abs(x), std::abs(y)), std::abs(z));
+            if (length <= 0.0f)
+                break;
+            axis[0] = x / length;
+            axis[1] = y / length;
+            axis[2] = z / length;
+        }
+        float axisLength = std::sqrt(axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2]);
+        for (int c = 0; c < 3; c++)
+            axis[c] /= axisLength;
+
+        float minT = FLT_MAX, maxT = -FLT_MAX;
+        for (int i = 0; i < 16; i++)
+        {
+            float t = (block[i * 4] - mean[0]) * axis[0] + (block[i * 4 + 1] - mean[1]) * axis[1] + (block[i * 4 + 2] - mean[2]) * axis[2];
+            minT = std::min(minT, t);
+            maxT = std::max(maxT, t);
+        }
+        float inset = (maxT - minT) / 16.0f;
+        float end0[3], end1[3];
+        for (int c = 0; c < 3; c++)
+        {
+            end0[c] = mean[c] + axis[c] * (maxT - inset);
+            end1[c] = mean[c] + axis[c] * (minT + inset);
+        }
+        uint16_t c0 = packRGB565(end0), c1 = packRGB565(end1);
+        if (c0 < c1)
+            std::swap(c0, c1);
+
+        uint32_t indices = 0;
+        if (c0 != c1)
+        {
+            float palette[4][3];
+            unpackRGB565(c0, palette[0]);
+            unpackRGB565(c1, palette[1]);
+            for (int c = 0; c < 3; c++)
+            {
+                palette[2][c] = (2.0f * palette[0][c] + palette[1][c]) / 3.0f;
+                palette[3][c] = (palette[0][c] + 2.0f * palette[1][c]) / 3.0f;
+            }
+            for (int i = 0; i < 16; i++)
+            {
+                uint32_t best = 0;
+                float bestDistance = FLT_MAX;
+                for (uint32_t p = 0; p < 4; p++)
+                {
+                    float distance = 0.0f;
+                    for (int c = 0; c < 3; c++)
+                    {
+                        float d = block[i * 4 + c] - palette[p][c];
+                        distance += d * d;
+                    }
+                    if (distance < bestDistance)
+                    {
+                        bestDistance = distance;
+                        best = p;
+                    }
+                }
+                indices |= best << (2 * i);
+            }
+        }
+        out[0] = (unsigned char)c0;
+        out[1] = (unsigned char)(c0 >> 8);
+        out[2] = (unsigned char)c1;
+        out[3] = (unsigned char)(c1 >> 8);
+        for (int i = 0; i < 4; i++)
+            out[4 + i] = (unsigned char)(indices >> (8 * i));
+    }
+
+    float srgbToLinear(float c)
+    {
+        c /= 255.0f;
+        return c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+    }
+
+    float linearToSRGB(float c)
+    {
+        c = c <= 0.0031308f ? c * 12.92f : 1.055f * std::pow(c, 1.0f / 2.4f) - 0.055f;
+        return c * 255.0f;
+    }
+
+    // 2x2 box filter for the next mip; odd edges repeat their last texel.
+    // sRGB colour is averaged in linear space so the mips don't darken.
+    void downsample(const std::vector<unsigned char>& src, int width, int height, bool srgb, std::vector<unsigned char>& dst)
+    {
+        int nextWidth = std::max(width / 2, 1), nextHeight = std::max(height / 2, 1);
+        dst.resize((size_t)nextWidth * nextHeight * 4);
+        float toLinear[256];
+        for (int i = 0; i < 256; i++)
+            toLinear[i] = srgb ? srgbToLinear((float)i) : (float)i;
+
+        for (int y = 0; y < nextHeight; y++)
+        {
+            for (int x = 0; x < nextWidth; x++)
+            {
+                const unsigned char* texels[4] = {
+                    &src[((size_t)std::min(2 * y, height - 1) * width + std::min(2 * x, width - 1)) * 4],
+                    &src[((size_t)std::min(2 * y, height - 1) * width + std::min(2 * x + 1, width - 1)) * 4],
+                    &src[((size_t)std::min(2 * y + 1, height - 1) * width + std::min(2 * x, width - 1)) * 4],
+                    &src[((size_t)std::min(2 * y + 1, height - 1) * width + std::min(2 * x + 1, width - 1)) * 4]
+                };
+                unsigned char* out = &dst[((size_t)y * nextWidth + x) * 4];
+                for (int c = 0; c < 4; c++)
+                {
+                    bool linear = c == 3 || !srgb;
+                    float sum = 0.0f;
+                    for (int t = 0; t < 4; t++)
+                        sum += linear ? texels[t][c] : toLinear[texels[t][c]];
+                    float value = linear ? sum / 4.0f : linearToSRGB(sum / 4.0f);
+                    out[c] = (unsigned char)std::min(std::max((int)std::lround(value), 0), 255);
+                }
+            }
+        }
+    }
+}
+
+TextureRole CompressedTexture::RoleFromType(const std::string& typeName)
+{
+    if (typeName == "texture_specular")
+        return TextureRole::Specular;
+    if (typeName == "texture_normal")
+        return TextureRole::Normal;
+    if (typeName == "texture_height")
+        return TextureRole::Height;
+    return TextureRole::Diffuse;
+}
+
+void CompressedTexture::DetectSupport()
+{
+    bool s3tc = false, srgb = false;
+    GLint count = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+    for (GLint i = 0; i < count; i++)
+    {
+        const char* name = (const char*)glGetStringi(GL_EXTENSIONS, (GLuint)i);
+        if (name == NULL)
+            continue;
+        if (std::strcmp(name, "GL_EXT_texture_compression_s3tc") == 0)
+            s3tc = true;
+        else if (std::strcmp(name, "GL_EXT_texture_sRGB") == 0 || std::strcmp(name, "GL_EXT_texture_compression_s3tc_srgb") == 0)
+            srgb = true;
+    }
+    s3tcSupported = s3tc;
+    // GL_EXT_texture_sRGB only adds the S3TC formats alongside S3TC itself
+    s3tcSRGBSupported = s3tc && srgb;
+#ifdef _DEBUG
+    if (!s3tcSupported)
+        std::cout << "No S3TC support, colour textures are uploaded uncompressed" << std::endl;
+    else if (!s3tcSRGBSupported)
+        std::cout << "No sRGB S3TC support, gamma textures are uploaded uncompressed" << std::endl;
+#endif
+}
+
+bool CompressedTexture::IsSupported(GLenum format)
+{
+    switch (format)
+    {
+    case GL_COMPRESSED_RGB_S3TC_DXT1_EXT:
+    case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT:
+        return s3tcSupported;
+    case GL_COMPRESSED_SRGB_S3TC_DXT1_EXT:
+    case GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT:
+        return s3tcSRGBSupported;
+    case GL_COMPRESSED_RED_RGTC1:
+    case GL_COMPRESSED_RG_RGTC2:
+        // Core since 3.0
+        return true;
+    }
+    return false;
+}
+
+bool CompressedTexture::Load(const std::string& path, TextureRole role, bool gamma, CompressedTexture& texture)
+{
+    if (path.size() > 4 && path.compare(path.size() - 4, 4, ".dds") == 0)
+    {
+        if (!texture.readDDS(path, gamma))
+            return false;
+        if (!IsSupported(texture.format))
+        {
+#ifdef _DEBUG
+            std::cout << "Texture format of " << path << " is not supported by this context" << std::endl;
+#endif
+            return false;
+        }
+        return true;
+    }
+
+    // Only the header is read here; the format depends on whether there is alpha
+    int width, height, channels;
+    if (!stbi_info(path.c_str(), &width, &height, &channels))
+        return false;
+    bool alpha = channels == 2 || channels == 4;
+    GLenum format;
+    switch (role)
+    {
+    case TextureRole::Diffuse:
+        if (alpha)
+            format = gamma ? GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT : GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+        else
+            format = gamma ? GL_COMPRESSED_SRGB_S3TC_DXT1_EXT : GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+        break;
+    case TextureRole::Normal:
+        format = GL_COMPRESSED_RG_RGTC2;
+        break;
+    default:
+        format = GL_COMPRESSED_RED_RGTC1;
+        break;
+    }
+    if (!IsSupported(format))
+        return false;
+
+    std::string cachePath = path + "." + findFormat(format)->suffix + ".dds";
+    std::error_code error;
+    auto sourceTime = std::filesystem::last_write_time(path, error);
+    if (!error)
+    {
+        auto cacheTime = std::filesystem::last_write_time(cachePath, error);
+        if (!error && cacheTime >= sourceTime && texture.readDDS(cachePath, gamma) && texture.format == format)
+            return true;
+    }
+
+    // Always decoded to RGBA so every block reads the same layout
+    unsigned char* pixels = stbi_load(path.c_str(), &width, &height, &channels, 4);
+    if (!pixels)
+        return false;
+    texture.format = format;
+    texture.compress(pixels, width, height);
+    stbi_image_free(pixels);
+    texture.writeDDS(cachePath);
+#ifdef _DEBUG
+    std::cout << "Compressed " << path << " (" << width << "x" << height << ") from "
+        << (size_t)width * height * 4 * 4 / 3 / 1024 << " KB to " << texture.GetSize() / 1024 << " KB" << std::endl;
+#endif
+    return true;
+}
+
+size_t CompressedTexture::Upload(GLuint textureID) const
+{
+    GLState::BindTexture(GL_TEXTURE_2D, textureID);
+    for (size_t i = 0; i < levels.size(); i++)
+    {
+        const Level& level = levels[i];
+        glCompressedTexImage2D(GL_TEXTURE_2D, (GLint)i, format, level.width, level.height, 0, (GLsizei)level.size, data.data() + level.offset);
+    }
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, (GLint)levels.size() - 1);
+
+    // Same sampling as uncompressed textures: images with alpha don't wrap
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, HasAlpha() ? GL_CLAMP_TO_EDGE : GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, HasAlpha() ? GL_CLAMP_TO_EDGE : GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    GLState::BindTexture(GL_TEXTURE_2D, 0);
+    return data.size();
+}
+
+bool CompressedTexture::HasAlpha() const
+{
+    return format == GL_COMPRESSED_RGBA_S3TC_DXT5_EXT || format == GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT;
+}
+
+bool CompressedTexture::readDDS(const std::string& path, bool gamma)
+{
+    MappedFile file(path);
+    if (!file.isValid() || file.getSize() < sizeof(uint32_t) + sizeof(DDSHeader))
+        return false;
+    const unsigned char* bytes = file.getData();
+    uint32_t magic;
+    DDSHeader header;
+    std::memcpy(&magic, bytes, sizeof(magic));
+    std::memcpy(&header, bytes + sizeof(magic), sizeof(header));
+    if (magic != DDS_MAGIC || header.size != sizeof(DDSHeader) || header.width == 0 || header.height == 0)
+        return false;
+
+    size_t offset = sizeof(magic) + sizeof(header);
+    const FormatInfo* info = NULL;
+    if (header.pixelFormat.flags & DDPF_FOURCC)
+    {
+        if (header.pixelFormat.fourCC == makeFourCC('D', 'X', '1', '0'))
+        {
+            DDSHeaderDX10 dx10;
+            if (file.getSize() < offset + sizeof(dx10))
+                return false;
+            std::memcpy(&dx10, bytes + offset, sizeof(dx10));
+            offset += sizeof(dx10);
+            info = findDXGIFormat(dx10.dxgiFormat);
+        }
+        else
+        {
+            // Legacy headers have no sRGB formats, so the caller says
+            info = findFourCC(header.pixelFormat.fourCC);
+            if (info && gamma)
+                info = findFormat(toSRGB(info->format));
+        }
+    }
+    if (!info)
+    {
+#ifdef _DEBUG
+        std::cout << "Unsupported DDS format in " << path << std::endl;
+#endif
+        return false;
+    }
+
+    uint32_t mipCount = (header.flags & DDSD_MIPMAPCOUNT) && header.mipMapCount > 0 ? header.mipMapCount : 1;
+    int width = (int)header.width, height = (int)header.height;
+    size_t size = 0;
+    levels.clear();
+    for (uint32_t i = 0; i < mipCount; i++)
+    {
+        size_t levelSize = (size_t)((width + 3) / 4) * ((height + 3) / 4) * info->blockSize;
+        levels.push_back({ width, height, size, levelSize });
+        size += levelSize;
+        width = std::max(width / 2, 1);
+        height = std::max(height / 2, 1);
+    }
+    if (file.getSize() < offset + size)
+        return false;
+
+    format = info->format;
+    data.assign(bytes + offset, bytes + offset + size);
+    return true;
+}
+
+bool CompressedTexture::writeDDS(const std::string& path) const
+{
+    const FormatInfo* info = findFormat(format);
+    if (!info || levels.empty())
+        return false;
+
+    DDSHeader header = {};
+    header.size = sizeof(DDSHeader);
+    header.flags = DDSD_CAPS | DDSD_HEIGHT | DDSD_WIDTH | DDSD_PIXELFORMAT | DDSD_MIPMAPCOUNT | DDSD_LINEARSIZE;
+    header.height = (uint32_t)levels[0].height;
+    header.width = (uint32_t)levels[0].width;
+    header.pitchOrLinearSize = (uint32_t)levels[0].size;
+    header.mipMapCount = (uint32_t)levels.size();
+    header.pixelFormat.size = sizeof(DDSPixelFormat);
+    header.pixelFormat.flags = DDPF_FOURCC;
+    header.pixelFormat.fourCC = makeFourCC('D', 'X', '1', '0');
+    header.caps[0] = DDSCAPS_TEXTURE | DDSCAPS_COMPLEX | DDSCAPS_MIPMAP;
+    DDSHeaderDX10 dx10 = {};
+    dx10.dxgiFormat = info->dxgiFormat;
+    dx10.resourceDimension = DX10_TEXTURE2D;
+    dx10.arraySize = 1;
+
+    // Two loader threads may compress the same image, so each writes its own
+    // temporary before renaming it over the cache
+    std::string tempPath = path + "." + std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id())) + ".tmp";
+    std::ofstream out(tempPath, std::ios::binary | std::ios::trunc);
+    if (!out)
+    {
+#ifdef _DEBUG
+        std::cout << "Could not write texture cache " << path << std::endl;
+#endif
+        return false;
+    }
+    out.write((const char*)&DDS_MAGIC, sizeof(DDS_MAGIC));
+    out.write((const char*)&header, sizeof(header));
+    out.write((const char*)&dx10, sizeof(dx10));
+    out.write((const char*)data.data(), data.size());
+    out.close();
+    std::error_code error;
+    if (out.fail())
+    {
+        std::filesystem::remove(tempPath, error);
+        return false;
+    }
+    std::filesystem::rename(tempPath, path, error);
+    return !error;
+}
+
+void CompressedTexture::compress(const unsigned char* rgba, int width, int height)
+{
+    const FormatInfo& info = *findFormat(format);
+    std::vector<unsigned char> level(rgba, rgba + (size_t)width * height * 4), next;
+    levels.clear();
+    data.clear();
+    while (true)
+    {
+        int blocksX = (width + 3) / 4, blocksY = (height + 3) / 4;
+        Level l = { width, height, data.size(), (size_t)blocksX * blocksY * info.blockSize };
+        data.resize(l.offset + l.size);
+
+        unsigned char block[64];
+        unsigned char* out = data.data() + l.offset;
+        for (int by = 0; by < blocksY; by++)
+        {
+            for (int bx = 0; bx < blocksX; bx++, out += info.blockSize)
+            {
+                // Blocks hanging over the edge repeat the last row/column
+                for (int y = 0; y < 4; y++)
+                {
+                    int sy = std::min(by * 4 + y, height - 1);
+                    for (int x = 0; x < 4; x++)
+                    {
+                        int sx = std::min(bx * 4 + x, width - 1);
+                        std::memcpy(&block[(y * 4 + x) * 4], &level[((size_t)sy * width + sx) * 4], 4);
+                    }
+                }
+
+                switch (format)
+                {
+                case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT:
+                case GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT:
+                    encodeBC4(block, 3, out);
+                    encodeBC1(block, out + 8);
+                    break;
+                case GL_COMPRESSED_RED_RGTC1:
+                    encodeBC4(block, 0, out);
+                    break;
+                case GL_COMPRESSED_RG_RGTC2:
+                    encodeBC4(block, 0, out);
+                    encodeBC4(block, 1, out + 8);
+                    break;
+                default:
+                    encodeBC1(block, out);
+                    break;
+                }
+            }
+        }
+        levels.push_back(l);
+
+        if (width == 1 && height == 1)
+            break;
+        downsample(level, width, height, isSRGB(format), next);
+        level.swap(next);
+        width = std::max(width / 2, 1);
+        height = std::max(height / 2, 1);
+    }
+}
@@ -0,0 +1,69 @@
+#pragma once
+#include <glad/glad.h>
+#include <string>
+#include <vector>
+
+// S3TC and its sRGB variants are extensions in core profiles (see DetectSupport)
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+#ifndef GL_COMPRESSED_SRGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_SRGB_S3TC_DXT1_EXT 0x8C4C
+#define GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT 0x8C4F
+#endif
+
+// What a material texture is used for, which decides its block format:
+//   Diffuse   BC1, or BC3 when the image has alpha (sRGB variants with gamma)
+//   Specular  BC4, the shader only reads .r
+//   Normal    BC5, x and y only; the shader rebuilds z
+//   Height    BC4
+enum class TextureRole {
+    Diffuse,
+    Specular,
+    Normal,
+    Height
+};
+
+// A block-compressed image with its whole mip chain, ready for
+// glCompressedTexImage2D.
+//
+// Load() reads .dds files directly. Any other image is compressed on first use
+// and cached next to it as <image>.<format>.dds (standard DDS with a DX10
+// header, so other tools can read or replace it); the cache is rebuilt when
+// the source is newer. Load() makes no GL calls, so it can run on a loader
+// thread; Upload() must run on the context thread.
+//
+// Load() declines, so callers upload the raw pixels instead, whenever the
+// format it would pick isn't supported by the context.
+class CompressedTexture
+{
+public:
+    struct Level {
+        int width, height;
+        size_t offset, size;
+    };
+
+    GLenum format = 0;
+    std::vector<Level> levels;
+    std::vector<unsigned char> data;
+
+    static TextureRole RoleFromType(const std::string& typeName);
+    // Reads the context's extensions; call once on the context thread before
+    // the first Load. Until then only the core RGTC formats are used.
+    static void DetectSupport();
+    static bool IsSupported(GLenum format);
+    // gamma picks the sRGB formats, also for legacy DXT1/DXT5 .dds files,
+    // whose header can't say
+    static bool Load(const std::string& path, TextureRole role, bool gamma, CompressedTexture& texture);
+
+    // Replaces textureID's storage with every level and sets the filtering.
+    // Returns the bytes uploaded.
+    size_t Upload(GLuint textureID) const;
+    bool HasAlpha() const;
+    inline size_t GetSize() const { return data.size(); }
+private:
+    bool readDDS(const std::string& path, bool gamma);
+    bool writeDDS(const std::string& path) const;
+    void compress(const unsigned char* rgba, int width, int height);
+};
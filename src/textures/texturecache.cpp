@@ -0,0 +1,80 @@
+#include "texturecache.h"
+
+#include <filesystem>
+#include "../model/assetloader.h"
+#include "../utils/fileutils.h"
+
+TextureCache& TextureCache::Get()
+{
+    static TextureCache cache;
+    return cache;
+}
+
+TextureHandle TextureCache::Acquire(const std::string& path, TextureRole role, bool gamma, GLint wrap,
+    AssetLoader* loader, const glm::vec4& placeholder)
+{
+    std::string key = makeKey(path, role, gamma, wrap);
+    auto entry = m_Entries.find(key);
+    if (entry != m_Entries.end())
+    {
+        if (TextureHandle resource = entry->second.lock())
+        {
+            m_Hits++;
+            return resource;
+        }
+    }
+    m_Misses++;
+
+    std::shared_ptr<TextureResource> resource(new TextureResource(), [this, key](TextureResource* r) { release(key, r); });
+    m_Entries[key] = resource;
+    if (loader)
+    {
+        // The callback keeps the texture alive until its upload has run, so
+        // the loader never writes to a deleted name
+        resource->id = loader->LoadTexture(path, role, gamma, placeholder, [this, resource, wrap](size_t bytes) {
+            uploaded(*resource, bytes, wrap);
+        });
+    }
+    else
+    {
+        size_t bytes = 0;
+        std::string directory = path.substr(0, path.find_last_of('/'));
+        std::string filename = path.substr(path.find_last_of('/') + 1);
+        resource->id = TextureFromFile(filename.c_str(), directory, gamma, role, &bytes);
+        uploaded(*resource, bytes, wrap);
+    }
+    return resource;
+}
+
+void TextureCache::uploaded(TextureResource& resource, size_t bytes, GLint wrap)
+{
+    resource.bytes = bytes;
+    m_ResidentBytes += bytes;
+    if (wrap != 0)
+    {
+        GLState::BindTexture(GL_TEXTURE_2D, resource.id);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, wrap);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, wrap);
+        GLState::BindTexture(GL_TEXTURE_2D, 0);
+    }
+}
+
+void TextureCache::release(const std::string& key, TextureResource* resource)
+{
+    GLState::DeleteTextures(1, &resource->id);
+    m_ResidentBytes -= resource->bytes;
+    // The slot may already hold a newer texture for the same key
+    auto entry = m_Entries.find(key);
+    if (entry != m_Entries.end() && entry->second.expired())
+        m_Entries.erase(entry);
+    delete resource;
+}
+
+std::string TextureCache::makeKey(const std::string& path, TextureRole role, bool gamma, GLint wrap)
+{
+    std::error_code error;
+    std::filesystem::path canonical = std::filesystem::weakly_canonical(std::filesystem::absolute(path, error), error);
+    std::string key = error ? path : canonical.generic_string();
+    key += '|' + std::to_string((int)role) + '|' + (gamma ? '1' : '0') + '|' + std::to_string(wrap);
+    return key;
+}
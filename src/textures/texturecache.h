@@ -0,0 +1,56 @@
+#pragma once
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+#include "compressedtexture.h"
+
+class AssetLoader;
+
+// A texture owned by the TextureCache. It stays resident while any handle
+// to it is alive and is deleted with the last one.
+struct TextureResource {
+    GLuint id = 0;
+    // GPU size, 0 until the image has been uploaded
+    size_t bytes = 0;
+};
+
+typedef std::shared_ptr<const TextureResource> TextureHandle;
+
+// Process-wide texture cache, so models that share an image share one texture.
+// Entries are keyed by canonical absolute path plus everything that changes
+// the uploaded result (role, sRGB, wrap), and only hold weak references:
+// nothing stays resident once the last handle is gone.
+//
+// Context thread only: handles may be copied anywhere, but must be released
+// on the context thread since the last one deletes the texture.
+class TextureCache
+{
+private:
+    std::unordered_map<std::string, std::weak_ptr<TextureResource>> m_Entries;
+    size_t m_Hits = 0;
+    size_t m_Misses = 0;
+    size_t m_ResidentBytes = 0;
+public:
+    static TextureCache& Get();
+
+    // wrap 0 keeps the default: clamp for images with alpha, repeat otherwise.
+    // With a loader the image streams in and placeholder is shown until then.
+    TextureHandle Acquire(const std::string& path, TextureRole role, bool gamma = false, GLint wrap = 0,
+        AssetLoader* loader = NULL, const glm::vec4& placeholder = glm::vec4(0.5f, 0.5f, 0.5f, 1.0f));
+
+    inline size_t GetHits() const { return m_Hits; }
+    inline size_t GetMisses() const { return m_Misses; }
+    inline size_t GetResidentCount() const { return m_Entries.size(); }
+    inline size_t GetResidentBytes() const { return m_ResidentBytes; }
+private:
+    TextureCache() {}
+    TextureCache(const TextureCache&) = delete;
+    TextureCache& operator=(const TextureCache&) = delete;
+
+    void uploaded(TextureResource& resource, size_t bytes, GLint wrap);
+    void release(const std::string& key, TextureResource* resource);
+    static std::string makeKey(const std::string& path, TextureRole role, bool gamma, GLint wrap);
+};
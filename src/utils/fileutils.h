@@ -1,7 +1,12 @@
 #pragma once
 
+#include <cstdio>
+#include <cstring>
+#include <iostream>
 #include <string>
 #include "stb_image.h"
+#include "glstate.h"
+#include "../textures/compressedtexture.h"
 
 static std::string read_file(const char* filepath)
 {
@@ -20,44 +25,69 @@ static std::string read_file(const char* filepath)
     return result;
 }
 
-static GLuint TextureFromFile(const char* path, const std::string& directory, bool gamma = false)
+// Fills an existing texture object from decoded stb_image data and builds its
+// mipmaps. Returns the approximate GPU size, mips included.
+static size_t UploadTexture(GLuint textureID, const unsigned char* data, int width, int height, int nrChannels, bool gamma = false)
 {
+    GLenum in_format = GL_RED, out_format = GL_RED;
+    if (nrChannels == 3)
+    {
+        in_format = gamma ? GL_SRGB : GL_RGB;
+        out_format = GL_RGB;
+    }
+    else if (nrChannels == 4)
+    {
+        in_format = gamma ? GL_SRGB_ALPHA : GL_RGBA;
+        out_format = GL_RGBA;
+    }
+
+    GLState::BindTexture(GL_TEXTURE_2D, textureID);
+    // stb_image rows are tightly packed, which RGB rows often aren't to 4 bytes
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexImage2D(GL_TEXTURE_2D, 0, in_format, width, height, 0, out_format, GL_UNSIGNED_BYTE, data);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glGenerateMipmap(GL_TEXTURE_2D);
+
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, out_format == GL_RGBA ? GL_CLAMP_TO_EDGE : GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, out_format == GL_RGBA ? GL_CLAMP_TO_EDGE : GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    GLState::BindTexture(GL_TEXTURE_2D, 0);
+    return (size_t)width * height * nrChannels * 4 / 3;
+}
+
+// Uploads the block-compressed version (see CompressedTexture) when the image
+// can be compressed, the raw pixels otherwise. bytes receives the GPU size.
+static GLuint TextureFromFile(const char* path, const std::string& directory, bool gamma = false, TextureRole role = TextureRole::Diffuse, size_t* bytes = NULL)
+{
+    size_t uploaded = 0;
     std::string filename = std::string(path);
     filename = directory + '/' + filename;
 
     GLuint textureID;
     glGenTextures(1, &textureID);
 
+    CompressedTexture compressed;
+    if (CompressedTexture::Load(filename, role, gamma, compressed))
+    {
+        uploaded = compressed.Upload(textureID);
+        if (bytes)
+            *bytes = uploaded;
+        return textureID;
+    }
+
     int width, height, nrChannels;
     unsigned char* data = stbi_load(filename.c_str(), &width, &height, &nrChannels, 0);
     if (data)
     {
-        GLenum in_format = GL_RED, out_format = GL_RED;
-        if (nrChannels == 3)
-        {
-            in_format = gamma ? GL_SRGB : GL_RGB;
-            out_format = GL_RGB;
-        }
-        else if (nrChannels == 4)
-        {
-            in_format = gamma ? GL_SRGB_ALPHA : GL_RGBA;
-            out_format = GL_RGBA;
-        }
-
-        glBindTexture(GL_TEXTURE_2D, textureID);
-        glTexImage2D(GL_TEXTURE_2D, 0, in_format, width, height, 0, out_format, GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
-
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, out_format == GL_RGBA ? GL_CLAMP_TO_EDGE : GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, out_format == GL_RGBA ? GL_CLAMP_TO_EDGE : GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        uploaded = UploadTexture(textureID, data, width, height, nrChannels, gamma);
     }
     else
     {
         std::cout << "Failed to load texture: " << path << std::endl;
     }
     stbi_image_free(data);
-    glBindTexture(GL_TEXTURE_2D, 0);
+    if (bytes)
+        *bytes = uploaded;
     return textureID;
 }
@@ -0,0 +1,243 @@
+#pragma once
+#include <glad/glad.h>
+#include <cstddef>
+
+// Shadow copy of the GL bindings the renderer changes all the time, so a
+// bind of what is already bound never reaches the driver. Every program,
+// framebuffer, VAO, buffer and texture bind in the renderer goes through
+// here; a direct glBind* elsewhere leaves the cache stale and must be
+// followed by Invalidate(). Names have to be deleted through the Delete*
+// calls too, since GL drops deleted names from its bindings.
+//
+// GL_ELEMENT_ARRAY_BUFFER is VAO state rather than context state and is
+// passed straight through. Context thread only.
+class GLState
+{
+public:
+    static const GLuint MAX_TEXTURE_UNITS = 32;
+
+    struct Stats
+    {
+        size_t issued = 0;
+        size_t elided = 0;
+    };
+private:
+    // Never a real name, so the next bind after Invalidate() always goes through
+    static const GLuint UNKNOWN = ~0u;
+    enum TextureTarget { Texture2D, TextureBuffer, TextureCubeMap, TEXTURE_TARGETS };
+    enum BufferTarget { ArrayBuffer, UniformBuffer, TextureBufferBinding, PixelPackBuffer, PixelUnpackBuffer, BUFFER_TARGETS };
+
+    GLuint m_Program;
+    GLuint m_ReadFramebuffer, m_DrawFramebuffer;
+    GLuint m_VertexArray;
+    GLuint m_Buffers[BUFFER_TARGETS];
+    GLuint m_ActiveUnit;
+    GLuint m_Textures[MAX_TEXTURE_UNITS][TEXTURE_TARGETS];
+    Stats m_Stats;
+
+    GLState() { reset(); }
+    static GLState& get()
+    {
+        static GLState state;
+        return state;
+    }
+public:
+    static void UseProgram(GLuint program)
+    {
+        GLState& s = get();
+        if (s.update(s.m_Program, program))
+            glUseProgram(program);
+    }
+
+    // GL_FRAMEBUFFER sets both the read and the draw binding
+    static void BindFramebuffer(GLenum target, GLuint framebuffer)
+    {
+        GLState& s = get();
+        bool read = target != GL_DRAW_FRAMEBUFFER && s.m_ReadFramebuffer != framebuffer;
+        bool draw = target != GL_READ_FRAMEBUFFER && s.m_DrawFramebuffer != framebuffer;
+        if (!read && !draw)
+        {
+            s.m_Stats.elided++;
+            return;
+        }
+        if (target == GL_FRAMEBUFFER && !(read && draw))
+            target = read ? GL_READ_FRAMEBUFFER : GL_DRAW_FRAMEBUFFER;
+        glBindFramebuffer(target, framebuffer);
+        if (read)
+            s.m_ReadFramebuffer = framebuffer;
+        if (draw)
+            s.m_DrawFramebuffer = framebuffer;
+        s.m_Stats.issued++;
+    }
+
+    // Returns whether the VAO actually changed
+    static bool BindVertexArray(GLuint vertexArray)
+    {
+        GLState& s = get();
+        if (!s.update(s.m_VertexArray, vertexArray))
+            return false;
+        glBindVertexArray(vertexArray);
+        return true;
+    }
+
+    static void BindBuffer(GLenum target, GLuint buffer)
+    {
+        GLState& s = get();
+        int slot = bufferSlot(target);
+        if (slot < 0)
+        {
+            glBindBuffer(target, buffer);
+            s.m_Stats.issued++;
+        }
+        else if (s.update(s.m_Buffers[slot], buffer))
+            glBindBuffer(target, buffer);
+    }
+
+    // Also binds the buffer to the generic target, as GL does
+    static void BindBufferRange(GLenum target, GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size)
+    {
+        GLState& s = get();
+        glBindBufferRange(target, index, buffer, offset, size);
+        int slot = bufferSlot(target);
+        if (slot >= 0)
+            s.m_Buffers[slot] = buffer;
+        s.m_Stats.issued++;
+    }
+
+    static void ActiveTexture(GLuint unit)
+    {
+        GLState& s = get();
+        if (s.update(s.m_ActiveUnit, unit))
+            glActiveTexture(GL_TEXTURE0 + unit);
+    }
+
+    // Binds to the active unit, for uploads and parameter changes
+    static void BindTexture(GLenum target, GLuint texture)
+    {
+        GLState& s = get();
+        BindTexture(s.m_ActiveUnit == UNKNOWN ? 0 : s.m_ActiveUnit, target, texture);
+    }
+
+    // The unit only becomes active if the binding actually changes
+    static void BindTexture(GLuint unit, GLenum target, GLuint texture)
+    {
+        GLState& s = get();
+        int slot = textureSlot(target);
+        if (slot >= 0 && unit < MAX_TEXTURE_UNITS && s.m_Textures[unit][slot] == texture)
+        {
+            s.m_Stats.elided++;
+            return;
+        }
+        ActiveTexture(unit);
+        glBindTexture(target, texture);
+        if (slot >= 0 && unit < MAX_TEXTURE_UNITS)
+            s.m_Textures[unit][slot] = texture;
+        s.m_Stats.issued++;
+    }
+
+    static void DeleteProgram(GLuint program)
+    {
+        GLState& s = get();
+        glDeleteProgram(program);
+        // A deleted program stays current until something else is used
+        if (s.m_Program == program)
+            s.m_Program = UNKNOWN;
+    }
+
+    static void DeleteFramebuffers(GLsizei count, const GLuint* framebuffers)
+    {
+        GLState& s = get();
+        glDeleteFramebuffers(count, framebuffers);
+        for (GLsizei i = 0; i < count; i++)
+        {
+            forget(s.m_ReadFramebuffer, framebuffers[i]);
+            forget(s.m_DrawFramebuffer, framebuffers[i]);
+        }
+    }
+
+    static void DeleteVertexArrays(GLsizei count, const GLuint* vertexArrays)
+    {
+        GLState& s = get();
+        glDeleteVertexArrays(count, vertexArrays);
+        for (GLsizei i = 0; i < count; i++)
+            forget(s.m_VertexArray, vertexArrays[i]);
+    }
+
+    static void DeleteBuffers(GLsizei count, const GLuint* buffers)
+    {
+        GLState& s = get();
+        glDeleteBuffers(count, buffers);
+        for (GLsizei i = 0; i < count; i++)
+            for (GLuint& bound : s.m_Buffers)
+                forget(bound, buffers[i]);
+    }
+
+    static void DeleteTextures(GLsizei count, const GLuint* textures)
+    {
+        GLState& s = get();
+        glDeleteTextures(count, textures);
+        for (GLsizei i = 0; i < count; i++)
+            for (auto& unit : s.m_Textures)
+                for (GLuint& bound : unit)
+                    forget(bound, textures[i]);
+    }
+
+    // For code that changed bindings behind the cache's back
+    static void Invalidate() { get().reset(); }
+
+    static const Stats& GetStats() { return get().m_Stats; }
+    static void ResetStats() { get().m_Stats = Stats(); }
+private:
+    bool update(GLuint& bound, GLuint name)
+    {
+        if (bound == name)
+        {
+            m_Stats.elided++;
+            return false;
+        }
+        bound = name;
+        m_Stats.issued++;
+        return true;
+    }
+
+    // Zero names are ignored by glDelete*, and never unbound by it
+    static void forget(GLuint& bound, GLuint name)
+    {
+        if (name != 0 && bound == name)
+            bound = UNKNOWN;
+    }
+
+    void reset()
+    {
+        m_Program = m_ReadFramebuffer = m_DrawFramebuffer = m_VertexArray = m_ActiveUnit = UNKNOWN;
+        for (GLuint& bound : m_Buffers)
+            bound = UNKNOWN;
+        for (auto& unit : m_Textures)
+            for (GLuint& bound : unit)
+                bound = UNKNOWN;
+    }
+
+    static int bufferSlot(GLenum target)
+    {
+        switch (target)
+        {
+        case GL_ARRAY_BUFFER: return ArrayBuffer;
+        case GL_UNIFORM_BUFFER: return UniformBuffer;
+        case GL_TEXTURE_BUFFER: return TextureBufferBinding;
+        case GL_PIXEL_PACK_BUFFER: return PixelPackBuffer;
+        case GL_PIXEL_UNPACK_BUFFER: return PixelUnpackBuffer;
+        default: return -1;
+        }
+    }
+
+    static int textureSlot(GLenum target)
+    {
+        switch (target)
+        {
+        case GL_TEXTURE_2D: return Texture2D;
+        case GL_TEXTURE_BUFFER: return TextureBuffer;
+        case GL_TEXTURE_CUBE_MAP: return TextureCubeMap;
+        default: return -1;
+        }
+    }
+};
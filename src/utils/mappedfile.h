@@ -0,0 +1,91 @@
+#pragma once
+#include <cstddef>
+#include <string>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Read-only memory mapping of a whole file. The pages are only read in as
+// they are touched, so uploading straight from getData() skips any copy.
+class MappedFile
+{
+private:
+    const unsigned char* m_Data = NULL;
+    size_t m_Size = 0;
+#ifdef _WIN32
+    HANDLE m_File = INVALID_HANDLE_VALUE;
+    HANDLE m_Mapping = NULL;
+#endif
+public:
+    MappedFile(const std::string& path)
+    {
+#ifdef _WIN32
+        m_File = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+        if (m_File == INVALID_HANDLE_VALUE)
+            return;
+        LARGE_INTEGER size;
+        if (!GetFileSizeEx(m_File, &size) || size.QuadPart == 0)
+            return;
+        m_Mapping = CreateFileMappingA(m_File, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (m_Mapping == NULL)
+            return;
+        m_Data = (const unsigned char*)MapViewOfFile(m_Mapping, FILE_MAP_READ, 0, 0, 0);
+        if (m_Data)
+            m_Size = (size_t)size.QuadPart;
+#else
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            return;
+        struct stat info;
+        if (fstat(fd, &info) == 0 && info.st_size > 0)
+        {
+            void* data = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (data != MAP_FAILED)
+            {
+                m_Data = (const unsigned char*)data;
+                m_Size = (size_t)info.st_size;
+            }
+        }
+        // The mapping stays valid after the descriptor is closed
+        close(fd);
+#endif
+    }
+    ~MappedFile()
+    {
+#ifdef _WIN32
+        if (m_Data)
+            UnmapViewOfFile(m_Data);
+        if (m_Mapping)
+            CloseHandle(m_Mapping);
+        if (m_File != INVALID_HANDLE_VALUE)
+            CloseHandle(m_File);
+#else
+        if (m_Data)
+            munmap((void*)m_Data, m_Size);
+#endif
+    }
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    // Faults every page in now, e.g. on a loader thread, so later readers
+    // don't stall on the disk
+    void touch() const
+    {
+        volatile unsigned char sink = 0;
+        for (size_t offset = 0; offset < m_Size; offset += 4096)
+            sink = sink ^ m_Data[offset];
+    }
+
+    inline bool isValid() const { return m_Data != NULL; }
+    inline const unsigned char* getData() const { return m_Data; }
+    inline size_t getSize() const { return m_Size; }
+};
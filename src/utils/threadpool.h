@@ -0,0 +1,115 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads pulling from a single task queue.
+class ThreadPool
+{
+private:
+    std::vector<std::thread> m_Workers;
+    std::queue<std::function<void()>> m_Tasks;
+    std::mutex m_Mutex;
+    std::condition_variable m_Condition;
+    bool m_Stop = false;
+public:
+    // Defaults to one worker per hardware thread, minus the calling thread
+    ThreadPool(unsigned threadCount = 0)
+    {
+        if (threadCount == 0)
+        {
+            unsigned hardware = std::thread::hardware_concurrency();
+            threadCount = hardware > 1 ? hardware - 1 : 1;
+        }
+        for (unsigned i = 0; i < threadCount; i++)
+            m_Workers.emplace_back([this]() { work(); });
+    }
+    ~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_Mutex);
+            m_Stop = true;
+        }
+        m_Condition.notify_all();
+        for (auto& worker : m_Workers)
+            worker.join();
+    }
+
+    void Enqueue(std::function<void()> task)
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_Mutex);
+            m_Tasks.push(std::move(task));
+        }
+        m_Condition.notify_one();
+    }
+
+    // Runs fn(begin, end) over [0, count) split into chunks of at least minChunk.
+    // The calling thread takes chunks too and returns once every chunk is done,
+    // so this never waits on unrelated work already sitting in the queue.
+    void ParallelFor(size_t count, const std::function<void(size_t, size_t)>& fn, size_t minChunk = 1)
+    {
+        if (count == 0)
+            return;
+        size_t chunkSize = std::max(minChunk, (count + m_Workers.size()) / (m_Workers.size() + 1));
+        size_t chunks = (count + chunkSize - 1) / chunkSize;
+        if (chunks == 1)
+        {
+            fn(0, count);
+            return;
+        }
+
+        struct Job
+        {
+            std::atomic<size_t> next{ 0 };
+            std::atomic<size_t> done{ 0 };
+            std::mutex mutex;
+            std::condition_variable finished;
+        };
+        // Helpers that start after the work is gone only touch the shared job
+        auto job = std::make_shared<Job>();
+        auto run = [job, chunks, chunkSize, count, &fn]() {
+            size_t chunk;
+            while ((chunk = job->next++) < chunks)
+            {
+                fn(chunk * chunkSize, std::min(count, (chunk + 1) * chunkSize));
+                if (++job->done == chunks)
+                {
+                    std::lock_guard<std::mutex> lock(job->mutex);
+                    job->finished.notify_all();
+                }
+            }
+        };
+        for (size_t i = 1; i < chunks && i <= m_Workers.size(); i++)
+            Enqueue(run);
+        run();
+
+        std::unique_lock<std::mutex> lock(job->mutex);
+        job->finished.wait(lock, [&job, chunks]() { return job->done == chunks; });
+    }
+
+    inline size_t GetThreadCount() const { return m_Workers.size(); }
+private:
+    void work()
+    {
+        while (true)
+        {
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lock(m_Mutex);
+                m_Condition.wait(lock, [this]() { return m_Stop || !m_Tasks.empty(); });
+                if (m_Stop && m_Tasks.empty())
+                    return;
+                task = std::move(m_Tasks.front());
+                m_Tasks.pop();
+            }
+            task();
+        }
+    }
+};
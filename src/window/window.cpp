@@ -1,19 +1,48 @@
 #include <iostream>
+#include <cstring>
 
 #include "window.h"
+#include "../utils/glstate.h"
+#include "../textures/compressedtexture.h"
 
-Window::Window(const char* title, int width, int height)
-    : m_Title(title), m_Width(width), m_Height(height)
+#ifdef LEARNOPENGL_EGL
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
+
+Window::Window(const char* title, int width, int height, bool headless)
+    : m_Title(title), m_Width(width), m_Height(height), m_Headless(headless), m_StartTime(std::chrono::steady_clock::now())
 {
-    if (!init())
-    {
-        glfwTerminate();
-    }
+    if (m_Headless)
+        m_Valid = initHeadless();
+    else
+        m_Valid = init();
+    if (!m_Valid)
+        m_ShouldClose = true;
 }
 
 Window::~Window()
 {
-    glfwTerminate();
+    if (!m_Headless)
+    {
+        glfwTerminate();
+        return;
+    }
+#ifdef LEARNOPENGL_EGL
+    if (m_Context != NULL)
+    {
+        // Only there once GLAD has loaded
+        if (m_Framebuffer != 0)
+        {
+            GLState::DeleteFramebuffers(1, &m_Framebuffer);
+            glDeleteRenderbuffers(2, m_Renderbuffers);
+        }
+        eglMakeCurrent((EGLDisplay)m_Display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+        eglDestroyContext((EGLDisplay)m_Display, (EGLContext)m_Context);
+    }
+    if (m_Display != NULL)
+        eglTerminate((EGLDisplay)m_Display);
+#endif
 }
 
 bool Window::init()
@@ -47,48 +76,173 @@ bool Window::init()
         return false;
     }
 
+    initState();
+    return true;
+}
+
+bool Window::initHeadless()
+{
+#ifdef LEARNOPENGL_EGL
+    // Prefer Mesa's surfaceless platform so no X server or GPU device is needed,
+    // falling back to whatever the default display is.
+    EGLDisplay display = EGL_NO_DISPLAY;
+    PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+    if (getPlatformDisplay != NULL)
+        display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+    if (display == EGL_NO_DISPLAY)
+        display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    if (display == EGL_NO_DISPLAY || !eglInitialize(display, NULL, NULL))
+    {
+        std::cout << "Failed to initialize EGL display" << std::endl;
+        return false;
+    }
+    m_Display = display;
+
+    if (!eglBindAPI(EGL_OPENGL_API))
+    {
+        std::cout << "EGL does not support desktop OpenGL" << std::endl;
+        return false;
+    }
+
+    const char* extensions = eglQueryString(display, EGL_EXTENSIONS);
+    EGLConfig config = EGL_NO_CONFIG_KHR;
+    if (extensions == NULL || std::strstr(extensions, "EGL_KHR_no_config_context") == NULL)
+    {
+        const EGLint configAttribs[] = {
+            EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+            EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+            EGL_NONE
+        };
+        EGLint numConfigs = 0;
+        if (!eglChooseConfig(display, configAttribs, &config, 1, &numConfigs) || numConfigs == 0)
+        {
+            std::cout << "Failed to choose EGL config" << std::endl;
+            return false;
+        }
+    }
+
+    const EGLint contextAttribs[] = {
+        EGL_CONTEXT_MAJOR_VERSION, 3,
+        EGL_CONTEXT_MINOR_VERSION, 3,
+        EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+        EGL_NONE
+    };
+    EGLContext context = eglCreateContext(display, config, EGL_NO_CONTEXT, contextAttribs);
+    if (context == EGL_NO_CONTEXT)
+    {
+        std::cout << "Failed to create EGL context" << std::endl;
+        return false;
+    }
+    m_Context = context;
+
+    if (!eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context))
+    {
+        std::cout << "Failed to make surfaceless EGL context current" << std::endl;
+        return false;
+    }
+
+    if (!gladLoadGLLoader((GLADloadproc)eglGetProcAddress))
+    {
+        std::cout << "Failed to initialize GLAD" << std::endl;
+        return false;
+    }
+
+    // Offscreen stand-in for the default framebuffer
+    // ----------------------------------------------
+    glGenFramebuffers(1, &m_Framebuffer);
+    glGenRenderbuffers(2, m_Renderbuffers);
+    GLState::BindFramebuffer(GL_FRAMEBUFFER, m_Framebuffer);
+    glBindRenderbuffer(GL_RENDERBUFFER, m_Renderbuffers[0]);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, m_Width, m_Height);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, m_Renderbuffers[0]);
+    glBindRenderbuffer(GL_RENDERBUFFER, m_Renderbuffers[1]);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, m_Width, m_Height);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, m_Renderbuffers[1]);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+    {
+        std::cout << "Offscreen framebuffer not complete" << std::endl;
+        return false;
+    }
+    glViewport(0, 0, m_Width, m_Height);
+
+#ifdef _DEBUG
+    std::cout << "Headless context: " << glGetString(GL_RENDERER) << " | " << glGetString(GL_VERSION) << std::endl;
+#endif
+
+    initState();
+    return true;
+#else
+    std::cout << "Headless mode requires a build with LEARNOPENGL_EGL" << std::endl;
+    return false;
+#endif
+}
+
+void Window::initState()
+{
     glEnable(GL_DEPTH_TEST);
     //glEnable(GL_FRAMEBUFFER_SRGB);
     //glEnable(GL_STENCIL_TEST);
     glDisable(GL_BLEND);
     glEnable(GL_CULL_FACE);
     glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+    CompressedTexture::DetectSupport();
     //glFrontFace(GL_CCW);
     //glCullFace(GL_FRONT);
 
     //glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-    
+
     m_Mouse.x = m_Width / 2;
     m_Mouse.y = m_Height / 2;
-    
-    return true;
 }
 
 void Window::close() const
 {
-    glfwSetWindowShouldClose(m_Window, true);
+    if (m_Headless)
+        m_ShouldClose = true;
+    else
+        glfwSetWindowShouldClose(m_Window, true);
 }
 
 bool Window::shouldClose() const
 {
+    if (m_Headless)
+        return m_ShouldClose;
     return glfwWindowShouldClose(m_Window);
 }
 
 bool Window::isKeyPressed(int keycode) const
 {
+    if (m_Headless)
+        return false;
     return glfwGetKey(m_Window, keycode) == GLFW_PRESS;
 }
 
 bool Window::isKeyReleased(int keycode) const
 {
+    if (m_Headless)
+        return true;
     return glfwGetKey(m_Window, keycode) == GLFW_RELEASE;
 }
 
+double Window::getTime() const
+{
+    if (!m_Headless)
+        return glfwGetTime();
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - m_StartTime).count();
+}
+
 void Window::update() const
 {
 #if _DEBUG
     check_errors();
 #endif
+    if (m_Headless)
+    {
+        // Nothing to present; make sure the frame's commands are actually executed
+        // so wall-clock frame times measure real work.
+        glFinish();
+        return;
+    }
     glfwPollEvents();
     glfwSwapBuffers(m_Window);
 }
@@ -156,4 +310,4 @@ void Window::scroll_callback(GLFWwindow* window, double xoffset, double yoffset)
     Window* win = (Window*)glfwGetWindowUserPointer(window);
     Camera* camera = win->getCamera(0);
     camera->zoom(yoffset);
-}
\ No newline at end of file
+}
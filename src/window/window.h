@@ -3,6 +3,7 @@
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
 #include <vector>
+#include <chrono>
 #include "../camera/camera.h"
 
 struct Mouse
@@ -15,13 +16,25 @@ struct Mouse
 class Window
 {
 private:
-    GLFWwindow* m_Window;
+    GLFWwindow* m_Window = NULL;
     const char* m_Title;
     int m_Width, m_Height;
     Mouse m_Mouse;
     std::vector<Camera*> cameras;
+
+    // Headless mode renders through an EGL surfaceless context into an
+    // offscreen framebuffer that stands in for the default framebuffer.
+    bool m_Headless;
+    // False when no context could be created; nothing may touch GL then
+    bool m_Valid = false;
+    mutable bool m_ShouldClose = false;
+    void* m_Display = NULL;
+    void* m_Context = NULL;
+    GLuint m_Framebuffer = 0;
+    GLuint m_Renderbuffers[2] = { 0, 0 };
+    std::chrono::steady_clock::time_point m_StartTime;
 public:
-    Window(const char* title, int width, int height);
+    Window(const char* title, int width, int height, bool headless = false);
     ~Window();
     static bool check_errors();
     static void clear(GLbitfield mask);
@@ -30,6 +43,10 @@ public:
     void update() const;
     bool isKeyPressed(int keycode) const;
     bool isKeyReleased(int keycode) const;
+    double getTime() const;
+    inline bool isValid() const { return m_Valid; }
+    inline bool isHeadless() const { return m_Headless; }
+    inline GLuint getDefaultFramebuffer() const { return m_Framebuffer; }
     inline int getWidth() const { return m_Width; }
     inline int getHeight() const { return m_Height; }
     inline float getAspectRatio() const { return (float)m_Width / (float)m_Height; }
@@ -38,7 +55,9 @@ public:
     inline Camera* getCamera(int index) { return cameras[index]; }
 private:
     bool init();
+    bool initHeadless();
+    void initState();
     static void framebuffer_size_callback(GLFWwindow* window, int width, int height);
     static void mouse_callback(GLFWwindow* window, double xpos, double ypos);
     static void scroll_callback(GLFWwindow* window, double xoffset, double yoffset);
-};
\ No newline at end of file
+};